@@ -1,7 +1,5 @@
 from flask import Flask, jsonify, request
-from flightsrun import run
-import json
-import os
+from flightsrun import InvalidConstraints, run
 from flask_cors import CORS
 
 app = Flask(__name__)
@@ -14,16 +12,6 @@ CORS(
     methods=["GET", "POST", "OPTIONS"]
 )
 
-def load_data_from_file():
-    try:
-        if os.path.exists('output.json'):
-            with open('output.json', 'r') as file:
-                return json.load(file)
-        else:
-            return {"message": "No data available."}
-    except Exception as e:
-        return {"error": f"Could not load data from file: {e}"}
-
 @app.route('/api/data', methods=['GET', 'POST', 'OPTIONS'])
 def handle_data():
     # Flask-CORS will handle OPTIONS and add required headers
@@ -33,16 +21,20 @@ def handle_data():
         destination = data.get('destination')
         day = data.get('day')
         departure_time = data.get('departure_time')
+        # optional: max_segments, max_layover, max_duration, avoid
+        constraints = data.get('constraints')
 
         if not all([source, destination, day, departure_time]):
             return jsonify({"error": "Missing one or more required fields"}), 400
 
         # Run the flight-finder logic
         print(f"Request: {source} → {destination} on {day} at {departure_time}")
-        run(source, destination, day, departure_time)
-
-        # Load the generated output.json
-        output_data = load_data_from_file()
+        try:
+            output_data = run(source, destination, day, departure_time, constraints)
+        except InvalidConstraints as e:
+            return jsonify({"error": f"Invalid constraints: {e}"}), 400
+        except Exception as e:
+            return jsonify({"error": f"Search failed: {e}"}), 500
         return jsonify(output_data)
 
     # GET or other
@@ -0,0 +1,86 @@
+/*
+  Parse throughput benchmark for cJSON.
+
+  Generates a large timetable in the same pretty-printed layout as data.json
+  and times cJSON_Parse and cJSON_ParseInSitu over it.
+
+  gcc -O2 cJSON.c bench.c -o bench -lm                     (SSE2 kernels on x86-64)
+  gcc -O2 -mavx2 cJSON.c bench.c -o bench -lm              (AVX2 kernels)
+  gcc -O2 -DCJSON_NO_SIMD cJSON.c bench.c -o bench -lm     (scalar baseline)
+  ./bench [flights] [rounds]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "cJSON.h"
+
+static const char *days[7]={"monday","tuesday","wednesday","thursday","friday","saturday","sunday"};
+
+/* Append formatted text to a growing buffer. */
+static char *buf;static size_t buflen,bufsize;
+static void emit(const char *fmt,...)
+{
+	va_list ap;int n;
+	if (bufsize-buflen<512) {bufsize=bufsize?bufsize*2:1<<20;buf=(char*)realloc(buf,bufsize);}
+	va_start(ap,fmt);n=vsprintf(buf+buflen,fmt,ap);va_end(ap);
+	buflen+=n;
+}
+
+/* Airports get synthetic three letter codes AAA, AAB, ... so every flight references a known one. */
+static void code(int i,char *out) {out[0]='A'+(i/676)%26;out[1]='A'+(i/26)%26;out[2]='A'+i%26;out[3]=0;}
+
+static void generate(int num_airports,int num_flights)
+{
+	int i,d;char from[4],to[4];
+	emit("{\n  \"airports\": [\n");
+	for (i=0;i<num_airports;i++)
+	{
+		code(i,from);
+		emit("    {\n      \"code\": \"%s\",\n      \"name\": \"Airport %d\",\n      \"latitude\": %.4f,\n      \"longitude\": %.4f,\n      \"min_waiting_time\": %d\n    }%s\n",
+			from,i,(i*37%180)-90.0,(i*71%360)-180.0,30+i%45,i==num_airports-1?"":",");
+	}
+	emit("  ],\n  \"flights\": [\n");
+	for (i=0;i<num_flights;i++)
+	{
+		code(i%num_airports,from);code((i*7+1)%num_airports,to);
+		emit("    {\n      \"from\": \"%s\",\n      \"to\": \"%s\",\n      \"base_cost\": %d.0,\n      \"distance\": %d.0,\n      \"schedule\": {\n",
+			from,to,100+i%900,500+i%9000);
+		for (d=0;d<7;d++)
+			emit("        \"%s\": {\n          \"departure_time\": \"%02d:%02d\",\n          \"arrival_time\": \"%02d:%02d\",\n          \"cost_multiplier\": %.2f,\n          \"available\": %s\n        }%s\n",
+				days[d],(i+d)%24,(i*5)%60,(i+d+3)%24,(i*5+15)%60,0.8+(i+d)%5*0.1,(i+d)%6?"true":"false",d==6?"":",");
+		emit("      }\n    }%s\n",i==num_flights-1?"":",");
+	}
+	emit("  ],\n  \"config\": {\n    \"min_connection_time\": 60\n  }\n}\n");
+}
+
+int main(int argc,char **argv)
+{
+	int num_flights=argc>1?atoi(argv[1]):20000,rounds=argc>2?atoi(argv[2]):20,i;
+	char *copy;clock_t start,total;cJSON *json;double mb;
+
+	generate(num_flights/10+26,num_flights);
+	mb=buflen/(1024.0*1024.0);
+	printf("timetable: %d flights, %.1f MB\n",num_flights,mb);
+
+	start=clock();
+	for (i=0;i<rounds;i++) {json=cJSON_Parse(buf);if (!json) {printf("parse failed\n");return 1;}cJSON_Delete(json);}
+	total=clock()-start;
+	printf("cJSON_Parse:       %8.1f MB/s\n",mb*rounds/((double)total/CLOCKS_PER_SEC));
+
+	/* In situ parsing consumes its input, so each round works on a fresh copy made outside the timed region. */
+	copy=(char*)malloc(buflen+1);total=0;
+	for (i=0;i<rounds;i++)
+	{
+		memcpy(copy,buf,buflen+1);
+		start=clock();
+		json=cJSON_ParseInSitu(copy);if (!json) {printf("parse failed\n");return 1;}cJSON_Delete(json);
+		total+=clock()-start;
+	}
+	printf("cJSON_ParseInSitu: %8.1f MB/s\n",mb*rounds/((double)total/CLOCKS_PER_SEC));
+
+	free(copy);free(buf);
+	return 0;
+}
@@ -32,7 +32,26 @@
 #include <ctype.h>
 #include "cJSON.h"
 
-static const char *ep;
+/* Vector kernels for the parser's hot loops. Build with -DCJSON_NO_SIMD to force the scalar code. */
+#if !defined(CJSON_NO_SIMD) && defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#define CJSON_SIMD_WIDTH 32
+#elif !defined(CJSON_NO_SIMD) && defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define CJSON_SIMD_WIDTH 16
+#endif
+
+/* Parser state is per thread, so separate threads can parse at the same time. */
+#if defined(__GNUC__)
+#define CJSON_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define CJSON_THREAD_LOCAL __declspec(thread)
+#else
+#define CJSON_THREAD_LOCAL
+#endif
+
+static CJSON_THREAD_LOCAL const char *ep;
+static CJSON_THREAD_LOCAL int insitu;	/* Set while cJSON_ParseInSitu runs: strings are unescaped over the source text. */
 
 const char *cJSON_GetErrorPtr(void) {return ep;}
 
@@ -85,8 +104,8 @@ void cJSON_Delete(cJSON *c)
 	{
 		next=c->next;
 		if (!(c->type&cJSON_IsReference) && c->child) cJSON_Delete(c->child);
-		if (!(c->type&cJSON_IsReference) && c->valuestring) cJSON_free(c->valuestring);
-		if (!(c->type&cJSON_StringIsConst) && c->string) cJSON_free(c->string);
+		if (!(c->type&(cJSON_IsReference|cJSON_StringIsInSitu)) && c->valuestring) cJSON_free(c->valuestring);
+		if (!(c->type&(cJSON_StringIsConst|cJSON_StringIsInSitu)) && c->string) cJSON_free(c->string);
 		cJSON_free(c);
 		c=next;
 	}
@@ -109,7 +128,7 @@ static const char *parse_number(cJSON *item,const char *num)
 	n=sign*n*pow(10.0,(scale+subscale*signsubscale));	/* number = +/- number.fraction * 10^+/- exponent */
 	
 	item->valuedouble=n;
-	item->valueint=(int)n;
+	item->valueint=(n>=INT_MAX)?INT_MAX:(n<=INT_MIN)?INT_MIN:(int)n;	/* out of range numbers saturate instead of overflowing */
 	item->type=cJSON_Number;
 	return num;
 }
@@ -187,22 +206,66 @@ static unsigned parse_hex4(const char *str)
 	return h;
 }
 
+/* Find the first quote, backslash or terminator from str on; these are the only bytes parse_string treats specially.
+Vector loads are only issued when they stay inside the current page, so they never fault past the terminator. */
+#ifdef CJSON_SIMD_WIDTH
+#define CJSON_LOAD_FITS(p) (((size_t)(p)&4095)<=4096-CJSON_SIMD_WIDTH)
+__attribute__((no_sanitize_address))
+#endif
+static const char *scan_string(const char *str)
+{
+	while (*str!='\"' && *str!='\\' && *str)
+	{
+#if CJSON_SIMD_WIDTH==32
+		if (CJSON_LOAD_FITS(str))
+		{
+			__m256i v=_mm256_loadu_si256((const __m256i*)str);
+			unsigned mask=(unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8('\"')),
+				_mm256_cmpeq_epi8(v,_mm256_set1_epi8('\\'))),_mm256_cmpeq_epi8(v,_mm256_setzero_si256())));
+			if (mask) return str+__builtin_ctz(mask);
+			str+=32;continue;
+		}
+#elif CJSON_SIMD_WIDTH==16
+		if (CJSON_LOAD_FITS(str))
+		{
+			__m128i v=_mm_loadu_si128((const __m128i*)str);
+			unsigned mask=(unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v,_mm_set1_epi8('\"')),
+				_mm_cmpeq_epi8(v,_mm_set1_epi8('\\'))),_mm_cmpeq_epi8(v,_mm_setzero_si128())));
+			if (mask) return str+__builtin_ctz(mask);
+			str+=16;continue;
+		}
+#endif
+		str++;
+	}
+	return str;
+}
+
 /* Parse the input text into an unescaped cstring, and populate item. */
 static const unsigned char firstByteMark[7] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC };
 static const char *parse_string(cJSON *item,const char *str)
 {
-	const char *ptr=str+1;char *ptr2;char *out;int len=0;unsigned uc,uc2;
+	const char *ptr=str+1,*end;char *ptr2;char *out;int len=0;unsigned uc,uc2;
 	if (*str!='\"') {ep=str;return 0;}	/* not a string! */
 	
-	while (*ptr!='\"' && *ptr && ++len) if (*ptr++ == '\\') ptr++;	/* Skip escaped quotes. */
-	
-	out=(char*)cJSON_malloc(len+1);	/* This is how long we need for the string, roughly. */
-	if (!out) return 0;
+	if (insitu) out=(char*)str+1;	/* Unescape over the source; the result is never longer than the escaped text. */
+	else
+	{
+		while (*(ptr=scan_string(ptr))=='\\') ptr+=ptr[1]?2:1;	/* Skip escaped quotes. */
+		len=ptr-(str+1);	/* Unescaping never lengthens the string. */
+		
+		out=(char*)cJSON_malloc(len+1);	/* This is how long we need for the string, roughly. */
+		if (!out) return 0;
+	}
 	
 	ptr=str+1;ptr2=out;
 	while (*ptr!='\"' && *ptr)
 	{
-		if (*ptr!='\\') *ptr2++=*ptr++;
+		if (*ptr!='\\')
+		{
+			const char *run=scan_string(ptr);	/* copy the plain run up to the next special char in one go. */
+			if (ptr2!=ptr) memmove(ptr2,ptr,run-ptr);
+			ptr2+=run-ptr;ptr=run;
+		}
 		else
 		{
 			ptr++;
@@ -241,11 +304,11 @@ static const char *parse_string(cJSON *item,const char *str)
 			ptr++;
 		}
 	}
+	end=(*ptr=='\"')?ptr+1:ptr;	/* Read the closing quote before the terminator can overwrite it in situ. */
 	*ptr2=0;
-	if (*ptr=='\"') ptr++;
 	item->valuestring=out;
-	item->type=cJSON_String;
-	return ptr;
+	item->type=cJSON_String|(insitu?cJSON_StringIsInSitu:0);
+	return end;
 }
 
 /* Render the cstring provided to an escaped version that can be printed. */
@@ -317,7 +380,35 @@ static const char *parse_object(cJSON *item,const char *value);
 static char *print_object(cJSON *item,int depth,int fmt,printbuffer *p);
 
 /* Utility to jump whitespace and cr/lf */
+#ifdef CJSON_SIMD_WIDTH
+/* Indentation runs are skipped a vector at a time; bytes 1..32 count as whitespace, as in the scalar loop. */
+__attribute__((no_sanitize_address))
+static const char *skip(const char *in)
+{
+	if (!in) return 0;
+	while (*in && (unsigned char)*in<=32)
+	{
+		if (CJSON_LOAD_FITS(in))
+		{
+#if CJSON_SIMD_WIDTH==32
+			__m256i v=_mm256_loadu_si256((const __m256i*)in);
+			__m256i ws=_mm256_andnot_si256(_mm256_cmpeq_epi8(v,_mm256_setzero_si256()),_mm256_cmpeq_epi8(_mm256_min_epu8(v,_mm256_set1_epi8(32)),v));
+			unsigned mask=~(unsigned)_mm256_movemask_epi8(ws);
+#else
+			__m128i v=_mm_loadu_si128((const __m128i*)in);
+			__m128i ws=_mm_andnot_si128(_mm_cmpeq_epi8(v,_mm_setzero_si128()),_mm_cmpeq_epi8(_mm_min_epu8(v,_mm_set1_epi8(32)),v));
+			unsigned mask=~(unsigned)_mm_movemask_epi8(ws)&0xFFFF;
+#endif
+			if (mask) return in+__builtin_ctz(mask);
+			in+=CJSON_SIMD_WIDTH;
+		}
+		else in++;
+	}
+	return in;
+}
+#else
 static const char *skip(const char *in) {while (in && *in && (unsigned char)*in<=32) in++; return in;}
+#endif
 
 /* Parse an object - create a new root, and populate. */
 cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated)
@@ -337,6 +428,8 @@ cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int r
 }
 /* Default options for cJSON_Parse */
 cJSON *cJSON_Parse(const char *value) {return cJSON_ParseWithOpts(value,0,0);}
+/* Parse in place: keys are marked const and values in situ, so cJSON_Delete leaves them in the caller's buffer. */
+cJSON *cJSON_ParseInSitu(char *value) {cJSON *c;insitu=1;c=cJSON_ParseWithOpts(value,0,0);insitu=0;return c;}
 
 /* Render a cJSON item/entity/structure to text. */
 char *cJSON_Print(cJSON *item)				{return print_value(item,0,1,0);}
@@ -527,6 +620,7 @@ static const char *parse_object(cJSON *item,const char *value)
 	child->string=child->valuestring;child->valuestring=0;
 	if (*value!=':') {ep=value;return 0;}	/* fail! */
 	value=skip(parse_value(child,skip(value+1)));	/* skip any spacing, get the value. */
+	if (insitu) child->type|=cJSON_StringIsConst;	/* the key lives in the source buffer. */
 	if (!value) return 0;
 	
 	while (*value==',')
@@ -539,6 +633,7 @@ static const char *parse_object(cJSON *item,const char *value)
 		child->string=child->valuestring;child->valuestring=0;
 		if (*value!=':') {ep=value;return 0;}	/* fail! */
 		value=skip(parse_value(child,skip(value+1)));	/* skip any spacing, get the value. */
+		if (insitu) child->type|=cJSON_StringIsConst;
 		if (!value) return 0;
 	}
 	
@@ -669,7 +764,7 @@ static cJSON *create_reference(cJSON *item) {cJSON *ref=cJSON_New_Item();if (!re
 
 /* Add item to array/object. */
 void   cJSON_AddItemToArray(cJSON *array, cJSON *item)						{cJSON *c=array->child;if (!item) return; if (!c) {array->child=item;} else {while (c && c->next) c=c->next; suffix_object(c,item);}}
-void   cJSON_AddItemToObject(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (item->string) cJSON_free(item->string);item->string=cJSON_strdup(string);cJSON_AddItemToArray(object,item);}
+void   cJSON_AddItemToObject(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (!(item->type&cJSON_StringIsConst) && item->string) cJSON_free(item->string);item->type&=~cJSON_StringIsConst;item->string=cJSON_strdup(string);cJSON_AddItemToArray(object,item);}
 void   cJSON_AddItemToObjectCS(cJSON *object,const char *string,cJSON *item)	{if (!item) return; if (!(item->type&cJSON_StringIsConst) && item->string) cJSON_free(item->string);item->string=(char*)string;item->type|=cJSON_StringIsConst;cJSON_AddItemToArray(object,item);}
 void	cJSON_AddItemReferenceToArray(cJSON *array, cJSON *item)						{cJSON_AddItemToArray(array,create_reference(item));}
 void	cJSON_AddItemReferenceToObject(cJSON *object,const char *string,cJSON *item)	{cJSON_AddItemToObject(object,string,create_reference(item));}
@@ -693,7 +788,7 @@ cJSON *cJSON_CreateNull(void)					{cJSON *item=cJSON_New_Item();if(item)item->ty
 cJSON *cJSON_CreateTrue(void)					{cJSON *item=cJSON_New_Item();if(item)item->type=cJSON_True;return item;}
 cJSON *cJSON_CreateFalse(void)					{cJSON *item=cJSON_New_Item();if(item)item->type=cJSON_False;return item;}
 cJSON *cJSON_CreateBool(int b)					{cJSON *item=cJSON_New_Item();if(item)item->type=b?cJSON_True:cJSON_False;return item;}
-cJSON *cJSON_CreateNumber(double num)			{cJSON *item=cJSON_New_Item();if(item){item->type=cJSON_Number;item->valuedouble=num;item->valueint=(int)num;}return item;}
+cJSON *cJSON_CreateNumber(double num)			{cJSON *item=cJSON_New_Item();if(item){item->type=cJSON_Number;item->valuedouble=num;item->valueint=(num>=INT_MAX)?INT_MAX:(num<=INT_MIN)?INT_MIN:(num==num)?(int)num:0;}return item;}
 cJSON *cJSON_CreateString(const char *string)	{cJSON *item=cJSON_New_Item();if(item){item->type=cJSON_String;item->valuestring=cJSON_strdup(string);}return item;}
 cJSON *cJSON_CreateArray(void)					{cJSON *item=cJSON_New_Item();if(item)item->type=cJSON_Array;return item;}
 cJSON *cJSON_CreateObject(void)					{cJSON *item=cJSON_New_Item();if(item)item->type=cJSON_Object;return item;}
@@ -714,7 +809,7 @@ cJSON *cJSON_Duplicate(cJSON *item,int recurse)
 	newitem=cJSON_New_Item();
 	if (!newitem) return 0;
 	/* Copy over all vars */
-	newitem->type=item->type&(~cJSON_IsReference),newitem->valueint=item->valueint,newitem->valuedouble=item->valuedouble;
+	newitem->type=item->type&(~(cJSON_IsReference|cJSON_StringIsConst|cJSON_StringIsInSitu)),newitem->valueint=item->valueint,newitem->valuedouble=item->valuedouble;
 	if (item->valuestring)	{newitem->valuestring=cJSON_strdup(item->valuestring);	if (!newitem->valuestring)	{cJSON_Delete(newitem);return 0;}}
 	if (item->string)		{newitem->string=cJSON_strdup(item->string);			if (!newitem->string)		{cJSON_Delete(newitem);return 0;}}
 	/* If non-recursive, then we're done! */
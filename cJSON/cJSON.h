@@ -39,6 +39,7 @@ extern "C"
 	
 #define cJSON_IsReference 256
 #define cJSON_StringIsConst 512
+#define cJSON_StringIsInSitu 1024
 
 /* The cJSON structure: */
 typedef struct cJSON {
@@ -65,6 +66,9 @@ extern void cJSON_InitHooks(cJSON_Hooks* hooks);
 
 /* Supply a block of JSON, and this returns a cJSON object you can interrogate. Call cJSON_Delete when finished. */
 extern cJSON *cJSON_Parse(const char *value);
+/* Like cJSON_Parse, but strings are unescaped in place inside value and the returned items point into it, so nothing is allocated for them.
+value is modified, and must stay alive until you cJSON_Delete the result (which does not free value). */
+extern cJSON *cJSON_ParseInSitu(char *value);
 /* Render a cJSON entity to text for transfer/storage. Free the char* when finished. */
 extern char  *cJSON_Print(cJSON *item);
 /* Render a cJSON entity to text for transfer/storage without any formatting. Free the char* when finished. */
@@ -0,0 +1,101 @@
+/*
+  Search coalescing benchmark.
+
+  Every round all threads are let go at once with the same query, like a burst
+  of users asking for the same route. The rounds are run once with every
+  thread searching for itself and once through planebooking_search_constrained,
+  where the threads that come in while a search runs share its answer. Both
+  runs use the shared worker pool of the library and the same deadline.
+
+  gcc -O2 -pthread coalesce_bench.c cJSON/cJSON.c -lm -o coalesce_bench
+  ./coalesce_bench <input.json> <from> <to> <day> <departure_time> [threads] [rounds]
+*/
+
+#define PLANEBOOKING_LIBRARY
+#include "main.c"
+
+#define BENCH_DEADLINE_MS 250
+
+Timetable* bench_tt;
+const char* bench_from;
+const char* bench_to;
+const char* bench_day;
+int bench_departure;
+int rounds;
+bool coalesce;
+pthread_barrier_t burst;
+atomic_int failures;
+
+double elapsed_seconds(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void* ask(void* arg) {
+    (void)arg;
+    for (int i = 0; i < rounds; i++) {
+        pthread_barrier_wait(&burst);
+        char* json_str = coalesce
+            ? planebooking_search_constrained(bench_tt, bench_from, bench_to, bench_day, bench_departure,
+                                              NULL, BENCH_DEADLINE_MS)
+            : route_search_json(library_pool, NULL, bench_tt, NULL, bench_from, bench_to, bench_day,
+                                bench_departure, NULL, search_deadline(BENCH_DEADLINE_MS));
+        if (!json_str) atomic_fetch_add(&failures, 1);
+        free(json_str);
+    }
+    return NULL;
+}
+
+double run_threads(int num_threads) {
+    pthread_t* threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    pthread_barrier_init(&burst, NULL, num_threads);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < num_threads; t++) {
+        pthread_create(&threads[t], NULL, ask, NULL);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    double seconds = elapsed_seconds(&start);
+    pthread_barrier_destroy(&burst);
+    free(threads);
+    return seconds;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 6) {
+        printf("Usage: %s <input.json> <from> <to> <day> <departure_time> [threads] [rounds]\n", argv[0]);
+        return 1;
+    }
+    bench_from = argv[2];
+    bench_to = argv[3];
+    bench_day = argv[4];
+    bench_departure = atoi(argv[5]);
+    int num_threads = (argc > 6) ? atoi(argv[6]) : 32;
+    rounds = (argc > 7) ? atoi(argv[7]) : 50;
+
+    bench_tt = parse_json_input(argv[1]);
+    if (!bench_tt) {
+        fprintf(stderr, "Failed to load a timetable from %s\n", argv[1]);
+        return 1;
+    }
+    pthread_once(&library_pool_once, create_library_pool);
+    printf("%d threads, %d bursts of %s-%s %s %d\n", num_threads, rounds, bench_from, bench_to,
+           bench_day, bench_departure);
+    int queries = num_threads * rounds;
+
+    coalesce = false;
+    double t = run_threads(num_threads);
+    printf("every query searches: %8.0f queries/s, %d searches\n", queries / t, queries);
+
+    coalesce = true;
+    t = run_threads(num_threads);
+    printf("shared searches:      %8.0f queries/s, %lld searches, %lld answers shared\n", queries / t,
+           route_flights.searches, route_flights.shared);
+    if (atomic_load(&failures) > 0) printf("%d queries failed\n", atomic_load(&failures));
+
+    timetable_release(bench_tt);
+    return 0;
+}
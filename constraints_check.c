@@ -0,0 +1,76 @@
+/*
+  Route search consistency check.
+
+  Runs random queries on a timetable without constraints and again with
+  limits no journey comes near: a layover of more than a week, a duration
+  of two years, 49 flights and all three at once. Limits that cannot bind
+  must leave the answer alone, so every journey has to come back flight for
+  flight the same. Prints the queries that differ and exits with 1 if any
+  did.
+
+  gcc -O2 -pthread constraints_check.c cJSON/cJSON.c -lm -o constraints_check
+  ./constraints_check <input.json> [queries] [seed]
+*/
+
+#define PLANEBOOKING_LIBRARY
+#include "main.c"
+
+#define NUM_LOOSE_LIMITS 4
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <input.json> [queries] [seed]\n", argv[0]);
+        return 1;
+    }
+    int queries = (argc > 2) ? atoi(argv[2]) : 300;
+    srand((argc > 3) ? (unsigned int)atoi(argv[3]) : 1);
+
+    Timetable* tt = parse_json_input(argv[1]);
+    SearchContext* ctx = search_context_create();
+    if (!tt || tt->num_airports < 2 || !ctx) {
+        fprintf(stderr, "Failed to load a timetable from %s\n", argv[1]);
+        return 1;
+    }
+    SearchConstraints loose[NUM_LOOSE_LIMITS];
+    memset(loose, 0, sizeof(loose));
+    loose[0].max_layover = 8 * 1440;
+    loose[1].max_duration = 2 * 365 * 1440;
+    loose[2].max_segments = MAX_PATH - 1;
+    loose[3].max_layover = 8 * 1440;
+    loose[3].max_duration = 2 * 365 * 1440;
+    loose[3].max_segments = MAX_PATH - 1;
+    const char* loose_names[NUM_LOOSE_LIMITS] = {"layover", "duration", "segments", "all"};
+
+    int searches = 0, found = 0, differences = 0;
+    for (int q = 0; q < queries; q++) {
+        int from = rand() % tt->num_airports;
+        int to = rand() % (tt->num_airports - 1);
+        if (to >= from) to++;
+        const char* day = days_of_week[rand() % 7];
+        int departure_time = rand() % 1440;
+        for (int r = 0; r < NUM_ROUTE_TYPES; r++) {
+            int path[MAX_PATH], path_size = 0;
+            bool ok = find_optimal_path(tt, NULL, ctx, tt->airports[from].code, tt->airports[to].code, day,
+                                        departure_time, (RouteType)r, NULL, 0, path, &path_size, NULL);
+            searches++;
+            if (ok) found++;
+            for (int l = 0; l < NUM_LOOSE_LIMITS; l++) {
+                int limited[MAX_PATH], limited_size = 0;
+                bool limited_ok = find_optimal_path(tt, NULL, ctx, tt->airports[from].code, tt->airports[to].code,
+                                                    day, departure_time, (RouteType)r, &loose[l], 0,
+                                                    limited, &limited_size, NULL);
+                if (limited_ok != ok || (ok && (limited_size != path_size ||
+                                                memcmp(limited, path, path_size * sizeof(int)) != 0))) {
+                    printf("differs: %s %s %s %d, route type %d, %s limit\n", tt->airports[from].code,
+                           tt->airports[to].code, day, departure_time, r, loose_names[l]);
+                    differences++;
+                }
+            }
+        }
+    }
+    printf("%d searches, %d found, %d differ with limits that cannot bind\n", searches, found, differences);
+
+    search_context_destroy(ctx);
+    timetable_release(tt);
+    return differences > 0 ? 1 : 0;
+}
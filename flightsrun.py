@@ -1,15 +1,136 @@
 # flightsrun.py
+import ctypes
+import json
+import os
+import re
 import subprocess
+import threading
 
-def run(source, destination, day, departure_time):
-    exe_path = "./main.exe"
-    input_file = "data.json"
+# The search engine is loaded in-process from a shared build of main.c:
+#   gcc -O2 -shared -fPIC -pthread -DPLANEBOOKING_LIBRARY main.c cJSON/cJSON.c -lm -o libplanebooking.so
+# (planebooking.dll on Windows). ctypes.CDLL drops the GIL for every call, so
+# Flask threads can search concurrently. Without the library we fall back to
+# running main.exe and reading output.json back.
+LIBRARY_NAME = "planebooking.dll" if os.name == "nt" else "libplanebooking.so"
+INPUT_FILE = "data.json"
+
+
+def _load_library():
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), LIBRARY_NAME)
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+
+    lib.planebooking_load.argtypes = [ctypes.c_char_p]
+    lib.planebooking_load.restype = ctypes.c_void_p
+    lib.planebooking_release.argtypes = [ctypes.c_void_p]
+    lib.planebooking_release.restype = None
+    lib.planebooking_apply_delta.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.planebooking_apply_delta.restype = ctypes.c_void_p
+    # returns a malloc'd string, kept as a raw pointer so it can be freed
+    lib.planebooking_search.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p,
+                                        ctypes.c_char_p, ctypes.c_int]
+    lib.planebooking_search.restype = ctypes.c_void_p
+    # the same with a json object of constraints, or None, and a deadline in ms, 0 for none
+    lib.planebooking_search_constrained.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p,
+                                                    ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p,
+                                                    ctypes.c_int]
+    lib.planebooking_search_constrained.restype = ctypes.c_void_p
+    # 1 if the constraints are valid, else 0 with the reason in the buffer
+    lib.planebooking_check_constraints.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p,
+                                                   ctypes.c_int]
+    lib.planebooking_check_constraints.restype = ctypes.c_int
+    lib.planebooking_free.argtypes = [ctypes.c_void_p]
+    lib.planebooking_free.restype = None
+    return lib
+
+
+_lib = _load_library()
+
+
+class InvalidConstraints(ValueError):
+    """The constraints of a search were rejected, the message says why."""
+
+
+def _minutes(departure_time):
+    # same reading of the argument as main.exe (atoi)
+    match = re.match(r"\s*[+-]?\d+", str(departure_time))
+    return int(match.group()) if match else 0
+
+
+class Timetable:
+    """A timetable loaded once and kept resident in the engine."""
+
+    def __init__(self, filename=INPUT_FILE):
+        self._handle = _lib.planebooking_load(filename.encode())
+        if not self._handle:
+            raise RuntimeError(f"Could not load timetable from {filename}")
+
+    def search_bytes(self, source, destination, day, departure_time, constraints=None, deadline_ms=0):
+        """Runs the cheapest/fastest/optimal searches, returns the raw json.
+
+        constraints is a dict with any of max_segments, max_layover,
+        max_duration (minutes) and avoid (a list of airport codes).
+        With a deadline the searches answer in time with the best journeys
+        found so far, flagged "best_effort" in the result.
+        """
+        limits = json.dumps(constraints).encode() if constraints else None
+        if limits:
+            # a bad query is told apart from a failed search
+            error = ctypes.create_string_buffer(128)
+            if not _lib.planebooking_check_constraints(self._handle, limits, error, len(error)):
+                raise InvalidConstraints(error.value.decode(errors="replace"))
+        result = _lib.planebooking_search_constrained(self._handle, source.encode(), destination.encode(),
+                                                      day.encode(), _minutes(departure_time), limits,
+                                                      deadline_ms)
+        if not result:
+            raise RuntimeError("Search failed")
+        try:
+            return ctypes.string_at(result)
+        finally:
+            _lib.planebooking_free(result)
+
+    def search(self, source, destination, day, departure_time, constraints=None, deadline_ms=0):
+        return json.loads(self.search_bytes(source, destination, day, departure_time, constraints,
+                                            deadline_ms))
+
+    def apply_delta(self, filename):
+        """Returns a new Timetable with the changes of a delta file applied,
+        this one is left as it is."""
+        handle = _lib.planebooking_apply_delta(self._handle, filename.encode())
+        if not handle:
+            raise RuntimeError(f"Could not apply delta {filename}")
+        updated = Timetable.__new__(Timetable)
+        updated._handle = handle
+        return updated
+
+    def close(self):
+        if self._handle:
+            _lib.planebooking_release(self._handle)
+            self._handle = None
+
+    def __del__(self):
+        if _lib:
+            self.close()
+
+
+_timetable = None
+# Flask serves requests on several threads, the first ones must not each load
+# a timetable of their own
+_timetable_lock = threading.Lock()
+# how long a search from the web app may take before it answers with the
+# best journeys found so far
+DEADLINE_MS = 250
+
+
+def _run_subprocess(source, destination, day, departure_time):
     output_file = "output.json"
 
     # Build the argument list
     args = [
-        exe_path,
-        input_file,
+        "./main.exe",
+        INPUT_FILE,
         output_file,
         source,
         destination,
@@ -21,7 +142,26 @@ def run(source, destination, day, departure_time):
         # Execute the command
         subprocess.run(args, check=True)
         print("Execution successful.")
+        with open(output_file, 'r') as file:
+            return json.load(file)
     except subprocess.CalledProcessError as e:
         print("Execution failed:", e)
     except FileNotFoundError:
         print("Executable not found. Check the path.")
+    return {"error": "Search could not be run."}
+
+
+def run(source, destination, day, departure_time, constraints=None):
+    """Returns the search result as a dict."""
+    global _timetable
+    if _lib is None:
+        # main.exe takes no constraints
+        if constraints:
+            return {"error": "Constraints need the search library."}
+        return _run_subprocess(source, destination, day, departure_time)
+
+    if _timetable is None:
+        with _timetable_lock:
+            if _timetable is None:
+                _timetable = Timetable(INPUT_FILE)
+    return _timetable.search(source, destination, day, departure_time, constraints, DEADLINE_MS)
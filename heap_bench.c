@@ -0,0 +1,182 @@
+/*
+  Open set micro-benchmark.
+
+  Replays the same stream of queue operations a search does on the 4-ary
+  heap with decrease-key and on the binary heap of node pointers it
+  replaced, where a cheaper journey queued a second node for the airport and
+  the stale one was skipped when it came out. Every round starts at one
+  airport and keeps taking out the cheapest, closing it and offering a new
+  cost for a few random airports that are not closed yet, until the queue is
+  empty.
+
+  gcc -O2 -pthread heap_bench.c cJSON/cJSON.c -lm -o heap_bench
+  ./heap_bench [rounds] [offers per airport]
+*/
+
+#define PLANEBOOKING_LIBRARY
+#include "main.c"
+
+#define OLD_QUEUE_SIZE 10000
+
+//the node and the queue of the previous search
+typedef struct {
+    int airport_index;
+    double g_cost;
+    double h_cost;
+    double f_cost;
+    int parent_index;
+    int flight_index;
+    int arrival_time;
+    char arrival_day[MAX_DAY_LENGTH];
+} OldNode;
+
+typedef struct {
+    OldNode* nodes[OLD_QUEUE_SIZE];
+    int size;
+} OldQueue;
+
+OldNode old_pool[OLD_QUEUE_SIZE + 2];
+OldNode* old_free[OLD_QUEUE_SIZE + 2];
+int old_num_free, old_num_used;
+
+void old_swap(OldQueue* q, int i, int j) {
+    OldNode* temp = q->nodes[i];
+    q->nodes[i] = q->nodes[j];
+    q->nodes[j] = temp;
+}
+
+bool old_enqueue(OldQueue* q, OldNode* node) {
+    if (q->size >= OLD_QUEUE_SIZE) return false;
+    q->nodes[q->size] = node;
+    int current = q->size++;
+    while (current > 0 && q->nodes[current]->f_cost < q->nodes[(current-1)/2]->f_cost) {
+        old_swap(q, current, (current-1)/2);
+        current = (current-1)/2;
+    }
+    return true;
+}
+
+OldNode* old_dequeue(OldQueue* q) {
+    if (q->size == 0) return NULL;
+    OldNode* min = q->nodes[0];
+    q->nodes[0] = q->nodes[--q->size];
+    int current = 0;
+    while (1) {
+        int left = 2*current + 1;
+        int right = 2*current + 2;
+        int smallest = current;
+        if (left < q->size && q->nodes[left]->f_cost < q->nodes[smallest]->f_cost) smallest = left;
+        if (right < q->size && q->nodes[right]->f_cost < q->nodes[smallest]->f_cost) smallest = right;
+        if (smallest == current) break;
+        old_swap(q, current, smallest);
+        current = smallest;
+    }
+    return min;
+}
+
+OldNode* old_alloc(void) {
+    if (old_num_free > 0) return old_free[--old_num_free];
+    if (old_num_used < OLD_QUEUE_SIZE + 2) return &old_pool[old_num_used++];
+    return NULL;
+}
+
+//the same pseudo random stream for both queues
+unsigned int rng_state;
+
+unsigned int next_random(void) {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return rng_state >> 8;
+}
+
+double elapsed_seconds(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+long long run_old(int rounds, int offers) {
+    static OldQueue q;
+    bool closed[MAX_AIRPORTS];
+    double best[MAX_AIRPORTS];
+    long long pops = 0;
+    rng_state = 1;
+    for (int r = 0; r < rounds; r++) {
+        q.size = 0;
+        old_num_free = old_num_used = 0;
+        for (int a = 0; a < MAX_AIRPORTS; a++) {
+            closed[a] = false;
+            best[a] = INFINITY_COST;
+        }
+        OldNode* start = old_alloc();
+        start->airport_index = 0;
+        start->g_cost = start->f_cost = 0.0;
+        best[0] = 0.0;
+        old_enqueue(&q, start);
+        while (q.size > 0) {
+            OldNode* current = old_dequeue(&q);
+            pops++;
+            if (closed[current->airport_index]) {
+                old_free[old_num_free++] = current;
+                continue;
+            }
+            closed[current->airport_index] = true;
+            for (int o = 0; o < offers; o++) {
+                int next = next_random() % MAX_AIRPORTS;
+                double cost = current->g_cost + 1.0 + next_random() % 1000;
+                if (closed[next] || !(cost < best[next])) continue;
+                best[next] = cost;
+                OldNode* node = old_alloc();
+                node->airport_index = next;
+                node->g_cost = node->f_cost = cost;
+                if (!old_enqueue(&q, node)) old_free[old_num_free++] = node;
+            }
+            old_free[old_num_free++] = current;
+        }
+    }
+    return pops;
+}
+
+long long run_new(int rounds, int offers) {
+    static SearchContext ctx;
+    long long pops = 0;
+    rng_state = 1;
+    for (int r = 0; r < rounds; r++) {
+        search_context_reset(&ctx);
+        search_context_visit(&ctx, 0);
+        ctx.nodes[0].g_cost = ctx.nodes[0].f_cost = 0;
+        pq_enqueue(&ctx.open_set, 0, 0);
+        while (ctx.open_set.size > 0) {
+            int current = pq_dequeue(&ctx.open_set);
+            pops++;
+            ctx.closed_set[current] = true;
+            for (int o = 0; o < offers; o++) {
+                int next = next_random() % MAX_AIRPORTS;
+                Cost cost = ctx.nodes[current].g_cost + 1 + next_random() % 1000;
+                search_context_visit(&ctx, next);
+                if (ctx.closed_set[next] || !(cost < ctx.nodes[next].g_cost)) continue;
+                ctx.nodes[next].g_cost = ctx.nodes[next].f_cost = cost;
+                pq_enqueue(&ctx.open_set, next, cost);
+            }
+        }
+    }
+    return pops;
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = (argc > 1) ? atoi(argv[1]) : 20000;
+    int offers = (argc > 2) ? atoi(argv[2]) : 20;
+    printf("node: %d bytes, was %d\n", (int)sizeof(Node), (int)sizeof(OldNode));
+    printf("%d rounds over %d airports, %d offers per airport\n", rounds, MAX_AIRPORTS, offers);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long old_pops = run_old(rounds, offers);
+    double t = elapsed_seconds(&start);
+    printf("binary heap of nodes:     %7.2f us per round, %lld pops\n", t * 1e6 / rounds, old_pops);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long long new_pops = run_new(rounds, offers);
+    t = elapsed_seconds(&start);
+    printf("4-ary heap, decrease-key: %7.2f us per round, %lld pops\n", t * 1e6 / rounds, new_pops);
+    return 0;
+}
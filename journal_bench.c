@@ -0,0 +1,86 @@
+/*
+  Booking journal group commit benchmark.
+
+  Every thread books a seat and cancels it again in a loop, each of them a
+  record that is only confirmed once it is on disk. The run is repeated for
+  a range of commit batch sizes. Batch size 1 never waits for a group to
+  fill, so it only groups the records that came in during the previous sync;
+  a batch larger than the number of threads always waits the full
+  GROUP_COMMIT_WAIT_US, as no more records than threads can be waiting.
+  The journal files are written to the current directory and removed after.
+
+  gcc -O2 -pthread journal_bench.c cJSON/cJSON.c -lm -o journal_bench
+  ./journal_bench <input.json> [threads] [bookings per thread]
+*/
+
+#define PLANEBOOKING_LIBRARY
+#include "main.c"
+
+#define BENCH_SNAPSHOT_FILE "journal_bench.json"
+#define BENCH_LOG_FILE "journal_bench.log"
+
+Timetable* bench_tt;
+BookingJournal* bench_journal;
+int bookings;
+atomic_int failures;
+
+void* book_and_cancel(void* arg) {
+    int flight = (int)(long)arg;
+    char booking_id[BOOKING_ID_LENGTH];
+    for (int i = 0; i < bookings; i++) {
+        if (book_seats(bench_journal, bench_tt, &flight, 1, ECONOMY, 1, booking_id) != BOOKING_DONE ||
+            cancel_seats(bench_journal, bench_tt, booking_id, 1) != BOOKING_DONE)
+            atomic_fetch_add(&failures, 1);
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <input.json> [threads] [bookings per thread]\n", argv[0]);
+        return 1;
+    }
+    int num_threads = (argc > 2) ? atoi(argv[2]) : 64;
+    bookings = (argc > 3) ? atoi(argv[3]) : 200;
+    int batch_sizes[] = {1, 4, 16, 64, 256};
+
+    bench_tt = parse_json_input(argv[1]);
+    if (!bench_tt || bench_tt->num_flights == 0) {
+        fprintf(stderr, "Failed to load a timetable from %s\n", argv[1]);
+        return 1;
+    }
+    pthread_t* threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    printf("%d threads, %d bookings and cancellations each\n", num_threads, bookings);
+
+    for (int b = 0; b < (int)(sizeof(batch_sizes) / sizeof(batch_sizes[0])); b++) {
+        remove(BENCH_SNAPSHOT_FILE);
+        remove(BENCH_LOG_FILE);
+        bench_journal = booking_journal_open(bench_tt, BENCH_SNAPSHOT_FILE, BENCH_LOG_FILE, batch_sizes[b]);
+        if (!bench_journal) return 1;
+        atomic_store(&failures, 0);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int t = 0; t < num_threads; t++) {
+            pthread_create(&threads[t], NULL, book_and_cancel, (void*)(long)(t % bench_tt->num_flights));
+        }
+        for (int t = 0; t < num_threads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        long long records = bench_journal->appended;
+        long long flushes = bench_journal->flushes;
+        booking_journal_close(bench_journal);
+        printf("batch %4d: %9.0f records/s, %6.1f records per sync, %d failed\n",
+               batch_sizes[b], records / seconds, flushes ? (double)records / flushes : 0.0,
+               atomic_load(&failures));
+    }
+
+    remove(BENCH_SNAPSHOT_FILE);
+    remove(BENCH_LOG_FILE);
+    free(threads);
+    timetable_release(bench_tt);
+    return 0;
+}
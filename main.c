@@ -1,3 +1,5 @@
+ #define _GNU_SOURCE  //accept4 in the http server
+ #define _CRT_RAND_S  //rand_s for the booking ids on windows
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
@@ -5,18 +7,234 @@
  #include <float.h>
  #define _USE_MATH_DEFINES
  #include <math.h>
+ #include <limits.h>
  #include <time.h>
  #include <ctype.h>
+ #include <stdatomic.h>
+ #include <pthread.h>
+ #ifdef _WIN32
+ #include <windows.h>
+ #include <io.h>
+ #else
+ #include <unistd.h>
+ #include <sched.h>
+ #endif
+ #ifdef __linux__
+ #include <errno.h>
+ #include <signal.h>
+ #include <strings.h>
+ #include <stdint.h>
+ #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+ #include <sys/socket.h>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+ #include <arpa/inet.h>
+ #endif
  #include "cJSON/cJSON.h"
  
 //Constants used across the program
  #define MAX_AIRPORTS 100
- #define MAX_FLIGHTS 1000
+ #define MAX_FLIGHTS 1000000
+ #define MAX_GROUPS 32
+ #define MAX_GROUP_AIRPORTS 8
+ #define MIN_FLIGHTS_PER_LOADER 512
  #define MAX_PATH 50
- #define INFINITY_COST 999999.0
- #define MAX_QUEUE_SIZE 10000
+ #define COST_SCALE 100
+ #define INFINITY_COST INT64_MAX
  #define MAX_DAY_LENGTH 10
  #define MAX_TIME_LENGTH 6
+ #define NUM_ROUTE_TYPES 3
+ #define NUM_CABINS 3
+ #define SEAT_BLOCK_SIZE 4096
+ #define DEFAULT_COMMIT_BATCH 64
+ #define GROUP_COMMIT_WAIT_US 1000
+ #define BOOKING_SNAPSHOT_FILE "bookings.json"
+ #define BOOKING_LOG_FILE "bookings.log"
+ #define BOOKING_ID_BYTES 16
+ #define BOOKING_ID_LENGTH (2 * BOOKING_ID_BYTES + 1)
+ #define FARE_UPDATE_INTERVAL 60
+ #define MINUTES_PER_WEEK (7 * 1440)
+ #define MAX_PROFILE_HORIZON (2 * 1440)
+ #define MAX_PROFILE_ENTRIES (1 << 20)
+ #define BASE_FARE_MULTIPLIER 0.9
+ #define NUM_LOAD_FARE_STEPS 4
+ #define NUM_DAYS_FARE_STEPS 3
+ #define MAX_SEARCH_KEY 512
+ #define MAX_ERROR_LENGTH 128
+ #define HISTOGRAM_SUB_BITS 5
+ #define HISTOGRAM_MAX_BITS 40
+ #define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+ #define MAX_TRACE_EVENTS (1 << 15)
+ 
+ /*allocation accounting, an optional build that counts the allocations by site:
+   gcc -O2 -pthread -DALLOC_ACCOUNTING main.c cJSON/cJSON.c -lm -o main.exe
+ every block gets a header with its size and the site it was made for, the
+ timetable loader, cJSON parsing and printing, the route searches or other,
+ so the number of allocations, the bytes and the live and peak memory can
+ be kept per site
+ cJSON allocates through cJSON_InitHooks, the engine through the malloc,
+ calloc, realloc and free macros below, at the site its thread is in, see
+ alloc_site_enter, a load reports what it allocated to stderr when it is done
+ and so do the queries of the command line and the http server
+ without the define none of it is compiled in
+*/
+ typedef enum {
+     ALLOC_OTHER,
+     ALLOC_LOADER,
+     ALLOC_JSON,
+     ALLOC_SEARCH,
+     NUM_ALLOC_SITES
+ } AllocSite;
+ 
+#ifdef ALLOC_ACCOUNTING
+ #define ALLOC_HEADER_SIZE 16  //the size and the site, keeps the block aligned like malloc's
+ 
+ typedef struct {
+     atomic_llong count;
+     atomic_llong bytes;
+     atomic_llong live;
+     atomic_llong peak;
+ } AllocCounters;
+ 
+//the allocations made up to some point, to compare before and after a load or a query
+ typedef struct {
+     long long count[NUM_ALLOC_SITES];
+     long long bytes[NUM_ALLOC_SITES];
+ } AllocTally;
+ 
+ const char* alloc_site_names[NUM_ALLOC_SITES] = {"other", "loader", "json", "search"};
+ AllocCounters alloc_counters[NUM_ALLOC_SITES];
+ atomic_llong alloc_live = 0;
+ atomic_llong alloc_peak = 0;
+ _Thread_local AllocSite alloc_site = ALLOC_OTHER;
+ _Thread_local AllocTally thread_allocs;  //the ones made by this thread
+ 
+ void alloc_raise_peak(atomic_llong* peak, long long live) {
+     long long seen = atomic_load_explicit(peak, memory_order_relaxed);
+     while (live > seen && !atomic_compare_exchange_weak(peak, &seen, live)) {
+     }
+ }
+ 
+ //counts count new blocks and size bytes allocated that change the live memory by live_change
+ void alloc_count(AllocSite site, int count, long long size, long long live_change) {
+     AllocCounters* c = &alloc_counters[site];
+     atomic_fetch_add_explicit(&c->count, count, memory_order_relaxed);
+     atomic_fetch_add_explicit(&c->bytes, size, memory_order_relaxed);
+     alloc_raise_peak(&c->peak, atomic_fetch_add(&c->live, live_change) + live_change);
+     alloc_raise_peak(&alloc_peak, atomic_fetch_add(&alloc_live, live_change) + live_change);
+     thread_allocs.count[site] += count;
+     thread_allocs.bytes[site] += size;
+ }
+ 
+ void* counted_alloc(size_t size, AllocSite site, bool zero) {
+     size_t* block = (size_t*)(zero ? calloc(1, ALLOC_HEADER_SIZE + size) : malloc(ALLOC_HEADER_SIZE + size));
+     if (!block) return NULL;
+     block[0] = size;
+     block[1] = site;
+     alloc_count(site, 1, (long long)size, (long long)size);
+     return (char*)block + ALLOC_HEADER_SIZE;
+ }
+ 
+ void* counted_malloc(size_t size) {
+     return counted_alloc(size, alloc_site, false);
+ }
+ 
+ void* counted_calloc(size_t count, size_t size) {
+     if (size > 0 && count > (size_t)-1 / size) return NULL;
+     return counted_alloc(count * size, alloc_site, true);
+ }
+ 
+ //a grown block stays with the site it was made for, a resize is not a new
+ //allocation, only the bytes it grows by are counted
+ void* counted_realloc(void* ptr, size_t size) {
+     if (!ptr) return counted_malloc(size);
+     size_t* block = (size_t*)((char*)ptr - ALLOC_HEADER_SIZE);
+     size_t old_size = block[0];
+     block = (size_t*)realloc(block, ALLOC_HEADER_SIZE + size);
+     if (!block) return NULL;
+     block[0] = size;
+     long long change = (long long)size - (long long)old_size;
+     alloc_count((AllocSite)block[1], 0, change > 0 ? change : 0, change);
+     return (char*)block + ALLOC_HEADER_SIZE;
+ }
+ 
+ void counted_free(void* ptr) {
+     if (!ptr) return;
+     size_t* block = (size_t*)((char*)ptr - ALLOC_HEADER_SIZE);
+     atomic_fetch_sub(&alloc_counters[block[1]].live, (long long)block[0]);
+     atomic_fetch_sub(&alloc_live, (long long)block[0]);
+     free(block);
+ }
+ 
+ void* json_malloc(size_t size) {
+     return counted_alloc(size, ALLOC_JSON, false);
+ }
+ 
+ //the hooks are in place before main, or as soon as the library is loaded,
+ //so no cJSON block is ever made without a header
+ __attribute__((constructor)) void install_json_hooks(void) {
+     cJSON_Hooks hooks = {json_malloc, counted_free};
+     cJSON_InitHooks(&hooks);
+ }
+ 
+ #define malloc(size) counted_malloc(size)
+ #define calloc(count, size) counted_calloc(count, size)
+ #define realloc(ptr, size) counted_realloc(ptr, size)
+ #define free(ptr) counted_free(ptr)
+ 
+ //the allocations of this thread from now on are made for site, returns the
+ //site to go back to with alloc_site_leave
+ AllocSite alloc_site_enter(AllocSite site) {
+     AllocSite previous = alloc_site;
+     alloc_site = site;
+     return previous;
+ }
+ 
+ void alloc_site_leave(AllocSite previous) {
+     alloc_site = previous;
+ }
+ 
+ //the allocations of every thread so far, or of this thread only
+ void alloc_tally(AllocTally* tally, bool this_thread) {
+     for (int s = 0; s < NUM_ALLOC_SITES; s++) {
+         tally->count[s] = this_thread ? thread_allocs.count[s] : atomic_load(&alloc_counters[s].count);
+         tally->bytes[s] = this_thread ? thread_allocs.bytes[s] : atomic_load(&alloc_counters[s].bytes);
+     }
+ }
+ 
+ //prints the allocations made since the tally before was taken, by site, by
+ //every thread or by this one, and the peak of the memory live at once so far
+ void alloc_report(const char* what, const char* name, const AllocTally* before, bool this_thread) {
+     AllocTally after;
+     alloc_tally(&after, this_thread);
+     fprintf(stderr, "Allocations for %s %s:", what, name);
+     for (int s = 0; s < NUM_ALLOC_SITES; s++) {
+         fprintf(stderr, " %s %lld (%lld bytes)%s", alloc_site_names[s], after.count[s] - before->count[s],
+                 after.bytes[s] - before->bytes[s], s + 1 < NUM_ALLOC_SITES ? "," : "");
+     }
+     fprintf(stderr, ", peak %lld bytes live\n", atomic_load(&alloc_peak));
+ }
+ 
+ //the allocations so far by site, with the memory live now and at the peak
+ cJSON* alloc_stats_json(void) {
+     cJSON* root = cJSON_CreateObject();
+     for (int s = 0; s < NUM_ALLOC_SITES; s++) {
+         cJSON* site = cJSON_CreateObject();
+         cJSON_AddItemToObject(root, alloc_site_names[s], site);
+         cJSON_AddNumberToObject(site, "count", (double)atomic_load(&alloc_counters[s].count));
+         cJSON_AddNumberToObject(site, "bytes", (double)atomic_load(&alloc_counters[s].bytes));
+         cJSON_AddNumberToObject(site, "live", (double)atomic_load(&alloc_counters[s].live));
+         cJSON_AddNumberToObject(site, "peak", (double)atomic_load(&alloc_counters[s].peak));
+     }
+     cJSON_AddNumberToObject(root, "live", (double)atomic_load(&alloc_live));
+     cJSON_AddNumberToObject(root, "peak", (double)atomic_load(&alloc_peak));
+     return root;
+ }
+#else
+ #define alloc_site_enter(site) ALLOC_OTHER
+ #define alloc_site_leave(previous) ((void)(previous))
+#endif
  
 //structure about the flight options
  typedef enum {
@@ -25,6 +243,19 @@
      OPTIMAL
  } RouteType;
  
+//cabins of a flight, each one sells its own seats
+ typedef enum {
+     ECONOMY,
+     BUSINESS,
+     FIRST
+ } CabinClass;
+ 
+/*money and route costs are fixed point integers in hundredths: a price in
+ cents, a FASTEST route cost in hundredths of a minute, so sums and
+ comparisons are exact and come out the same on every build
+*/
+ typedef int64_t Cost;
+ 
 //structure about the airport information
  typedef struct {
      char code[4];  //IATA code of the airport
@@ -41,41 +272,475 @@
      int departure_time;
      int arrival_time;
      int duration;
-     double cost;
+     Cost base_cost;  //in cents
+     Cost cost;       //base_cost * cost_multiplier, in cents
      double distance;
      char day_of_week[MAX_DAY_LENGTH];
      bool available;
+     int from_index;  //index of the origin in airports, -1 if unknown
+     int to_index;    //index of the destination in airports, -1 if unknown
+     int seats[NUM_CABINS];  //seats for sale in every cabin
  } ScheduledFlight;
  
+//airports serving the same city, a query for the code of the group covers all of them
+ typedef struct {
+     char code[4];
+     int airports[MAX_GROUP_AIRPORTS];  //indices into airports
+     int count;
+ } AirportGroup;
+ 
+//a departing flight with its departure in minutes from monday 00:00
+ typedef struct {
+     int minute_of_week;
+     int flight_index;
+ } Departure;
+ 
+//per airport index of the departing flights
+//kept up to date by the delta updates so the search never scans all flights
+//sorted by departure, so a search only looks at the flights it can connect to
+//the arrivals of an airport are kept in the same form, by the minute of
+//week the flights land at, for the searches that go back from an arrival
+ typedef struct {
+     Departure* flights;  //by minute_of_week, flights leaving at the same time by index
+     int count;
+     int capacity;
+ } DepartureList;
+ 
  /*structure about the node
  used in the A* algorithm
  where f is a function of g and h
  which are about the cost based on 
  distance and total money
+ the reachability searches keep one node per airport, the best journey to
+ it found so far, kept to 32 bytes so two of them share a cache line, h is f - g and the airport
+ is the position of the node in the search context
 */
  typedef struct Node {
-     int airport_index;
-     double g_cost;
-     double h_cost;
-     double f_cost;
-     int parent_index;
-     int flight_index;
+     Cost g_cost;
+     Cost f_cost;
+     int parent_index;  //airport the journey came from, -1 at a start airport
+     int flight_index;  //flight into the airport, -1 at a start airport
      int arrival_time;
-     char arrival_day[MAX_DAY_LENGTH];
+     int arrival_day;   //index into days_of_week, -1 if the start day is not one
  } Node;
  
-//priority queue structure
+ /*priority queue structure, a 4-ary min-heap of airports by f cost
+ the keys are kept apart from the airports so sifting only reads one
+ contiguous array, and four children are one cache line of keys
+ every airport is queued at most once: position maps an airport to its
+ place in the heap, so a cheaper journey lowers the key in place
+ (decrease-key) instead of queueing the airport a second time
+*/
  typedef struct {
-     Node* nodes[MAX_QUEUE_SIZE];
+     Cost keys[MAX_AIRPORTS];
+     int airports[MAX_AIRPORTS];
+     int position[MAX_AIRPORTS];  //-1 if the airport is not queued
      int size;
  } PriorityQueue;
  
-//constants used across the program
- Airport airports[MAX_AIRPORTS];
- ScheduledFlight flights[MAX_FLIGHTS];
- int num_airports = 0;
- int num_flights = 0;
- int connection_time_required = 60;
+ /*a journey of a route search, which can keep several per airport, see
+ find_label_path_kernel, the labels of a search are kept in one array
+ and point to the journey they extend by its index
+*/
+ typedef struct {
+     Cost g_cost;
+     Cost f_cost;
+     int airport_index;
+     int parent;         //label the journey came from, -1 at a start airport
+     int flight_index;   //flight into the airport, -1 at a start airport
+     int arrival_time;
+     int arrival_day;
+     int segments;       //flights of the journey
+     int elapsed;        //minutes from its first departure to the arrival
+     int next;           //next label kept at the same airport, -1 for the last
+     bool dominated;     //a journey to the airport as good in every way was found
+ } Label;
+ 
+ /*scratch state of the A* search, one per thread
+ it owns the per airport arrays, the open set and the nodes, so a search
+ allocates nothing and several searches can run at the same time on
+ different contexts
+ the arrays are not cleared between searches: every query gets a new
+ generation and a slot whose stamp is from an older generation counts
+ as unvisited
+*/
+ typedef struct {
+     unsigned int generation;
+     unsigned int stamp[MAX_AIRPORTS];
+     bool closed_set[MAX_AIRPORTS];
+     Node nodes[MAX_AIRPORTS];  //the best journey to every airport
+     PriorityQueue open_set;
+     //the labels of a route search, grown when a search needs more and
+     //kept for the next one, the queue is a binary min-heap of labels by f cost
+     Label* labels;
+     int* label_queue;
+     int label_count;
+     int label_capacity;
+     int label_queue_size;
+     int label_head[MAX_AIRPORTS];  //first label kept at an airport, -1 for none
+ } SearchContext;
+ 
+/*limits a route search has to keep to, checked on every flight the search
+ relaxes so journeys that break them are never extended, zero is no limit
+ a search keeps every journey to an airport that no other one beats in all
+ of them, so a dearer journey that still keeps to the limits is not lost on
+ the way, and limits that do not bind give the journey found without them
+*/
+ typedef struct {
+     int max_segments;  //flights, at most MAX_PATH
+     int max_layover;   //minutes between two flights at a connecting airport
+     int max_duration;  //minutes from the first departure to the last arrival
+     bool excluded[MAX_AIRPORTS];  //airports not to fly to
+ } SearchConstraints;
+ 
+/*an immutable snapshot of the timetable
+ a snapshot is never changed once it is published, a reload or a delta builds
+ a new one and swaps it in, so a search always sees one consistent timetable
+ it is freed when the last reader releases it
+*/
+ typedef struct Timetable {
+     Airport airports[MAX_AIRPORTS];
+     ScheduledFlight* flights;
+     DepartureList departures[MAX_AIRPORTS];
+     DepartureList arrivals[MAX_AIRPORTS];  //by destination and arrival
+     AirportGroup groups[MAX_GROUPS];
+     int num_airports;
+     int num_groups;
+     int num_flights;
+     int flight_capacity;
+     int connection_time_required;
+     struct SeatLedger* seats_sold;  //shared with the snapshots derived from it, see SeatLedger
+     long long version;              //unique to the snapshot, the fares are tied to it
+     atomic_int refcount;
+ } Timetable;
+ 
+/*the current fare of every flight in every cabin, by flight index, built by
+ a pricing pass published like the timetable, the searches read the economy
+ fares in place of the static cost of the flights, a booking is priced in its
+ own cabin, a table priced from another snapshot is not used, a
+ delta can change the flights behind the indices, until a pass has priced
+ the new snapshot too, see snapshot_fares
+*/
+ typedef struct {
+     Cost* cost[NUM_CABINS];  //by cabin, in cents
+     int count;
+     long long timetable_version;  //version of the snapshot it was priced from
+     atomic_int refcount;
+ } FareTable;
+ 
+/*the columns a pricing pass works on, one entry per flight
+ the static ones are gathered again when a new timetable is published,
+ the load factor and the days to departure on every pass
+*/
+ typedef struct {
+     Timetable* tt;              //the snapshot the static columns come from, referenced
+     int count;
+     int capacity;
+     double* static_cost;        //base_cost * cost_multiplier, in cents
+     double* minute_of_week;     //departure, in minutes from monday 00:00
+     double* days;               //until the next departure
+     double* seats[NUM_CABINS];  //for sale in the cabin
+     double* load[NUM_CABINS];   //share of the cabin sold
+     double* fare[NUM_CABINS];   //priced, in cents before rounding
+ } FareEngine;
+ 
+//fare step rules: a fare goes up a step at every load factor its cabin
+//reaches and at every days to departure limit it gets under
+ typedef struct {
+     double threshold;
+     double step;
+ } FareStep;
+ 
+//the flights built from a slice of the flights array by one loader thread
+ typedef struct {
+     const Timetable* tt;  //read only, the airports are already loaded
+     cJSON** entries;      //the slice of flight entries, in input order
+     int first;            //position of the slice in the flights array
+     int count;
+     ScheduledFlight* flights;
+     int num_flights;
+     int capacity;
+     bool failed;
+ } FlightChunk;
+ 
+//tasks of one request, the submitter waits until pending drops to zero
+ typedef struct {
+     pthread_mutex_t lock;
+     pthread_cond_t done;
+     int pending;
+ } SearchBatch;
+ 
+//one find_optimal_path call handed to the worker pool, with its result
+ typedef struct SearchTask {
+     const Timetable* tt;
+     const FareTable* fares;
+     const char* from;
+     const char* to;
+     const char* day;
+     int departure_time;
+     RouteType route_type;
+     const SearchConstraints* constraints;  //NULL for none
+     long long deadline_us;  //see search_deadline, 0 for none
+     int path[MAX_PATH];
+     int path_size;
+     bool found;
+     bool best_effort;  //the deadline stopped the search, a path found is not known to be the best
+     SearchBatch* batch;
+     struct SearchTask* next;
+ } SearchTask;
+ 
+ /*a fixed set of search threads shared by all requests
+ tasks are taken in submission order, every worker has its own search context
+*/
+ typedef struct {
+     pthread_mutex_t lock;
+     pthread_cond_t has_work;
+     SearchTask* head;
+     SearchTask* tail;
+     bool stopping;
+     int num_workers;
+     pthread_t* workers;
+ } WorkerPool;
+ 
+ /*identical route searches in flight at the same time run once
+ the first caller of a query searches, callers with the same key that come in
+ while it runs wait for it and get a copy of its json, a query that comes in
+ after it finished searches again, so nothing is cached
+ the key names the snapshots searched, which stay alive while the leader
+ holds them, so a query on a newer timetable or newer fares never attaches
+ to one on the old ones
+*/
+ typedef struct InFlightSearch {
+     char key[MAX_SEARCH_KEY];
+     char* result;         //the shared json, NULL while searching or if it failed
+     bool done;
+     int waiters;          //followers still to take their copy
+     struct InFlightSearch* next;
+ } InFlightSearch;
+ 
+ typedef struct {
+     pthread_mutex_t lock;
+     pthread_cond_t finished;
+     InFlightSearch* head;
+     long long searches;   //queries searched
+     long long shared;     //queries answered by another one's search
+ } SearchFlights;
+ 
+//the timed phases of a request, the searches are in RouteType order
+ typedef enum {
+     PHASE_PARSE,
+     PHASE_TIMETABLE,
+     PHASE_SEARCH_CHEAPEST,
+     PHASE_SEARCH_FASTEST,
+     PHASE_SEARCH_OPTIMAL,
+     PHASE_RECONSTRUCT,
+     PHASE_SERIALIZE,
+     NUM_PHASES
+ } Phase;
+ 
+ /*latency histogram of a phase, in nanoseconds, log linear like an HDR histogram
+ every power of two is split into 1 << HISTOGRAM_SUB_BITS buckets, so a
+ bucket is at most 1/32 of its values wide, durations from 2^HISTOGRAM_MAX_BITS
+ ns (about 18 minutes) on go to the last bucket
+ the counters are atomics, so the threads record without a lock
+*/
+ typedef struct {
+     atomic_llong counts[HISTOGRAM_BUCKETS];
+     atomic_llong total;
+     atomic_llong sum_ns;
+     atomic_llong max_ns;
+ } LatencyHistogram;
+ 
+ /*a timed phase in the trace ring, which keeps the last MAX_TRACE_EVENTS
+ sequence is the number of the event plus one once it is written and 0 while
+ it is being written, a reader that sees it change skips the event
+*/
+ typedef struct {
+     atomic_llong sequence;
+     int phase;
+     int thread;
+     long long start_ns;
+     long long duration_ns;
+ } TraceEvent;
+ 
+//reprices the flights in the background, see run_pricing_pass
+ typedef struct {
+     pthread_mutex_t lock;
+     pthread_cond_t wake;
+     bool stopping;
+     int interval_seconds;
+     pthread_t thread;
+ } PricingThread;
+ 
+ //a flight as the journal names it, like the delta file does
+ typedef struct {
+     char from[4];
+     char to[4];
+     char day[MAX_DAY_LENGTH];
+     int departure_time;
+ } FlightKey;
+
+ /* a booking the journal holds seats for, found by its id, which is random
+ so only the customer it was given to can cancel it, its flights are kept by
+ key so the booking outlives a reload of the timetable
+*/
+ typedef struct Booking {
+     char id[BOOKING_ID_LENGTH];
+     CabinClass cabin;
+     int seats;             //still held, a partial cancellation lowers it
+     int releasing;         //cancellations not on disk yet, it stays in the table for them
+     int count;
+     struct Booking* next;  //in its bucket
+     FlightKey legs[];
+ } Booking;
+
+ typedef struct {
+     pthread_mutex_t lock;
+     Booking** buckets;
+     int bucket_count;
+     int count;
+ } BookingTable;
+
+ /* booking journal
+ every booking and release is appended to a write-ahead log before it is
+ confirmed, one line per record:
+   journal <generation>
+   book <id> <cabin> <seats> <legs> <from> <to> <day> <HH:MM> [<from> <to> <day> <HH:MM> ...]
+   release <id> <seats>
+ the first line names the snapshot the log builds on, the legs name their
+ flights like the delta file does, so the log stays valid across restarts
+ a line without its newline is a write cut short by a crash and is ignored
+ (logs from before the ids have no id in either record, their seats are
+ replayed but belong to no booking)
+
+ the snapshot is the compacted state, the seats sold on every flight and the
+ bookings still holding seats:
+   {"generation": 3, "seats_sold": [{"from": "NYC", "to": "LON", "day": "tuesday",
+     "departure_time": "10:30", "economy": 2, "business": 0, "first": 1}, ...],
+    "bookings": [{"id": "3f9a...", "cabin": "economy", "seats": 2, "segments": [{"from": "NYC",
+     "to": "LON", "day": "tuesday", "departure_time": "10:30"}, ...]}, ...]}
+ on startup the snapshot is loaded, the log is replayed on top if it builds on
+ that generation, and both are compacted into a snapshot of the next generation
+ and an empty log, a crash between the two leaves a log of an older generation
+ that is skipped, as the new snapshot already has it
+
+ records are committed in groups: the bookers append to a shared buffer and
+ wait, a flusher thread writes the buffer and syncs it once for the whole
+ group, when batch_size records are waiting or GROUP_COMMIT_WAIT_US after
+ the first one came in
+*/
+ typedef struct {
+     FILE* log;
+     int generation;
+     int batch_size;
+     pthread_mutex_t lock;
+     pthread_cond_t has_records;  //wakes the flusher
+     pthread_cond_t committed;    //wakes the bookers
+     char* buffer;                //records not written yet
+     int length;
+     int capacity;
+     int pending;                 //number of records in the buffer
+     long long appended;          //sequence number of the last record appended
+     long long durable;           //every record up to this one is on disk
+     long long flushes;
+     bool failed;
+     bool stopping;
+     pthread_t flusher;
+     BookingTable bookings;
+ } BookingJournal;
+
+//how a booking or a cancellation went
+ typedef enum {
+     BOOKING_DONE,
+     BOOKING_REFUSED,   //not enough seats, or a release of more seats than the booking holds
+     BOOKING_UNKNOWN,   //no booking has the id
+     BOOKING_FAILED     //the record could not be written
+ } BookingResult;
+ 
+/* the readers between loading a published pointer and taking their reference
+ a reader counts itself on the side the gate is open on, a publisher swaps
+ the pointer, turns the gate to the other side and waits for the side it
+ closed to empty, readers coming in meanwhile count on the other side and
+ cannot keep it waiting, one publisher at a time
+*/
+ typedef struct {
+     atomic_int side;
+     atomic_int readers[2];
+ } ReaderGate;
+
+//the published timetable
+ _Atomic(Timetable*) current_timetable = NULL;
+ atomic_llong timetable_versions = 0;
+ ReaderGate timetable_readers;
+//taken by timetable_publish, so that publishers never carry the seats sold
+//over from the same timetable
+ pthread_mutex_t publish_lock = PTHREAD_MUTEX_INITIALIZER;
+//held by the server from reading the published timetable to publishing the
+//one made from it, so a delta is never applied to a timetable that another
+//delta or a reload is replacing
+ pthread_mutex_t timetable_update_lock = PTHREAD_MUTEX_INITIALIZER;
+//shared by a booking from taking the timetable until its record is in the
+//journal, exclusive for a publish that carries the seats sold over, which
+//would miss the seats of a booking on the old ledger
+ #ifdef PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
+ pthread_rwlock_t booking_lock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+ #else
+ pthread_rwlock_t booking_lock = PTHREAD_RWLOCK_INITIALIZER;
+ #endif
+ 
+//the route searches in flight, shared by the http workers and library callers
+ SearchFlights route_flights = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0};
+ 
+//the timings of the phases, see phase_record
+ const char* phase_names[NUM_PHASES] = {
+     "parse", "timetable", "search cheapest", "search fastest", "search optimal",
+     "reconstruct", "serialize"
+ };
+ LatencyHistogram phase_histograms[NUM_PHASES];
+ TraceEvent trace_events[MAX_TRACE_EVENTS];
+ atomic_llong trace_next = 0;
+ atomic_int trace_threads = 0;
+ _Thread_local int trace_thread = 0;  //numbered from 1 when it first records
+ 
+//the fares published by the pricing thread, NULL while the static costs apply
+ _Atomic(FareTable*) current_fares = NULL;
+ ReaderGate fare_readers;
+ 
+//an empty cabin starts 10% below its fare, a full one costs up to 70% more
+ const FareStep load_fare_steps[NUM_LOAD_FARE_STEPS] = {
+     {0.30, 0.10}, {0.60, 0.15}, {0.80, 0.20}, {0.95, 0.35}
+ };
+//and the last days before departure add up to another 30%
+ const FareStep days_fare_steps[NUM_DAYS_FARE_STEPS] = {
+     {3.0, 0.05}, {1.0, 0.10}, {0.25, 0.15}
+ };
+ 
+ /*seats sold on every flight, by cabin
+ the counters are kept outside the snapshots, in a ledger shared by a loaded
+ timetable and the snapshots deltas derive from it: a delta keeps the indices
+ of the flights it starts from, so swapping snapshots leaves the bookings in
+ place, only the number of seats is read from the snapshot
+ a timetable loaded on its own numbers its flights its own way and gets its
+ own ledger, so timetables loaded side by side never share counters, and
+ publishing one over another carries the seats sold over by flight, see
+ seat_ledger_carry_over
+ a block of counters is allocated the first time one of its flights is
+ booked, a flight without a block has sold nothing
+*/
+ typedef struct {
+     atomic_int sold[SEAT_BLOCK_SIZE][NUM_CABINS];
+ } SeatBlock;
+ 
+ typedef struct SeatLedger {
+     _Atomic(SeatBlock*) blocks[(MAX_FLIGHTS + SEAT_BLOCK_SIZE - 1) / SEAT_BLOCK_SIZE];
+     atomic_int refcount;
+ } SeatLedger;
+ 
+ const char* cabin_names[NUM_CABINS] = {"economy", "business", "first"};
+ //used when a flight does not list its seats
+ const int default_cabin_seats[NUM_CABINS] = {150, 30, 8};
+ //the fare of a cabin against the static cost of the flight, before the steps
+ const double cabin_fare_multipliers[NUM_CABINS] = {1.0, 2.5, 4.0};
  
  const char* days_of_week[] = {
      "monday", "tuesday", "wednesday", "thursday", 
@@ -85,90 +750,202 @@
 //functions used in the program
 int time_to_minutes(const char* time_str);
 int time_difference(int time1, int time2);
-int find_airport_index(const char* code);
+int find_airport_index(const Timetable* tt, const char* code);
+int find_airport_set(const Timetable* tt, const char* code, int* airports);
 double calculate_distance(double lat1, double lon1, double lat2, double lon2);
-double heuristic(int current_index, int goal_index, RouteType route_type);
+Cost heuristic(const Timetable* tt, int current_index, int goal_index, RouteType route_type);
 bool is_connection_possible(int arrival_time, int next_departure_time,
                           const char* arrival_day, const char* departure_day,
                           int min_connection_time);
-double calculate_route_cost(RouteType route_type, double cost, int duration, double distance);
+Cost calculate_route_cost(RouteType route_type, Cost cost, int duration, double distance);
 int calculate_wait_time(int arrival_time, const char* arrival_day,
                       int next_departure_time, const char* departure_day);
 void get_next_day(const char* current_day, char* next_day);
+int find_day_index(const char* day);
+void seat_ledger_carry_over(const Timetable* from, const Timetable* to);
 
 // intializes an empty priority
+//the positions are not cleared here, an airport has to have position -1
+//before it is first queued, search_context_visit sets it
  void pq_init(PriorityQueue* q) {
      q->size = 0;
  }
  
- //function to swap the element sin th priority queue
- //this is used during operations enqueue and dequeue
- void pq_swap(PriorityQueue* q, int i, int j) {
-     Node* temp = q->nodes[i];
-     q->nodes[i] = q->nodes[j];
-     q->nodes[j] = temp;
+ //moves the airport with the given key up from the hole at slot current
+ //until its parent is not more expensive, and puts it there
+ void pq_sift_up(PriorityQueue* q, int current, int airport_index, Cost key) {
+     while (current > 0) {
+         int parent = (current - 1) / 4;
+         if (!(key < q->keys[parent])) break;
+         q->keys[current] = q->keys[parent];
+         q->airports[current] = q->airports[parent];
+         q->position[q->airports[current]] = current;
+         current = parent;
+     }
+     q->keys[current] = key;
+     q->airports[current] = airport_index;
+     q->position[airport_index] = current;
  }
  
- //adds node in the priority queue and maintains the min-heap property
- void pq_enqueue(PriorityQueue* q, Node* node) {
-     if (q->size >= MAX_QUEUE_SIZE) {
-         fprintf(stderr, "Error: Priority queue overflow\n");
+ //queues an airport with key f_cost, or lowers its key if it is already queued
+ //a key that is not lower than the queued one is ignored
+ void pq_enqueue(PriorityQueue* q, int airport_index, Cost f_cost) {
+     int current = q->position[airport_index];
+     if (current < 0) {
+         current = q->size++;
+     } else if (!(f_cost < q->keys[current])) {
          return;
      }
-     
-     //add node at the end
-     q->nodes[q->size] = node;
-     int current = q->size++;
-     
-     //heapify up
-     while (current > 0 && 
-            q->nodes[current]->f_cost < q->nodes[(current-1)/2]->f_cost) {
-         pq_swap(q, current, (current-1)/2);
-         current = (current-1)/2;
-     }
+     pq_sift_up(q, current, airport_index, f_cost);
  }
  
- //removes and returns the node with the lowest f_cost from the priority queue
- Node* pq_dequeue(PriorityQueue* q) {
-     if (q->size == 0) return NULL;
+ //removes and returns the airport with the lowest f_cost, -1 if the queue is empty
+ int pq_dequeue(PriorityQueue* q) {
+     if (q->size == 0) return -1;
      
      //get the min element
-     Node* min = q->nodes[0];
-     //move the last element to the root
-     q->nodes[0] = q->nodes[--q->size];
+     int min = q->airports[0];
+     q->position[min] = -1;
+     //the last element goes down from the root
+     int last = --q->size;
+     if (last == 0) return min;
+     Cost key = q->keys[last];
+     int airport_index = q->airports[last];
      
-     //heapify down
+     //heapify down, moving the cheapest of the four children up into the hole
      int current = 0;
      while (1) {
-         int left = 2*current + 1;
-         int right = 2*current + 2;
-         int smallest = current;
-         
-         //find the smallest among the current, left and right child
-         if (left < q->size && 
-             q->nodes[left]->f_cost < q->nodes[smallest]->f_cost)
-             smallest = left;
-             
-         if (right < q->size && 
-             q->nodes[right]->f_cost < q->nodes[smallest]->f_cost)
-             smallest = right;
-             
-         if (smallest == current) break;
-             
-         pq_swap(q, current, smallest);
+         int first = 4*current + 1;
+         if (first >= last) break;
+         int end = first + 4 < last ? first + 4 : last;
+         int smallest = first;
+         for (int child = first + 1; child < end; child++) {
+             if (q->keys[child] < q->keys[smallest]) smallest = child;
+         }
+         if (!(q->keys[smallest] < key)) break;
+         q->keys[current] = q->keys[smallest];
+         q->airports[current] = q->airports[smallest];
+         q->position[q->airports[current]] = current;
          current = smallest;
      }
-     
+     q->keys[current] = key;
+     q->airports[current] = airport_index;
+     q->position[airport_index] = current;
      return min;
  }
-
+ 
+ //creates a search context, each thread running searches needs its own
+ SearchContext* search_context_create(void) {
+     SearchContext* ctx = (SearchContext*)calloc(1, sizeof(SearchContext));
+     if (!ctx) fprintf(stderr, "Error: Memory allocation failed\n");
+     return ctx;
+ }
+ 
+ void search_context_destroy(SearchContext* ctx) {
+     if (!ctx) return;
+     free(ctx->labels);
+     free(ctx->label_queue);
+     free(ctx);
+ }
+ 
+ //starts a new search on the context in constant time
+ void search_context_reset(SearchContext* ctx) {
+     ctx->generation++;
+     //after a wrap around old stamps could look current again
+     if (ctx->generation == 0) {
+         memset(ctx->stamp, 0, sizeof(ctx->stamp));
+         ctx->generation = 1;
+     }
+     pq_init(&ctx->open_set);
+     ctx->label_count = 0;
+     ctx->label_queue_size = 0;
+ }
+ 
+ //gives the per airport slot its initial values the first time the
+ //current search touches it
+ void search_context_visit(SearchContext* ctx, int airport_index) {
+     if (ctx->stamp[airport_index] == ctx->generation) return;
+     ctx->stamp[airport_index] = ctx->generation;
+     ctx->closed_set[airport_index] = false;
+     ctx->open_set.position[airport_index] = -1;
+     Node* node = &ctx->nodes[airport_index];
+     node->g_cost = INFINITY_COST;
+     node->f_cost = INFINITY_COST;
+     node->parent_index = -1;
+     node->flight_index = -1;
+     node->arrival_time = -1;
+     node->arrival_day = -1;
+     ctx->label_head[airport_index] = -1;
+ }
+ 
+ //a new label in the context, its index, -1 if the arrays could not grow
+ int search_context_add_label(SearchContext* ctx) {
+     if (ctx->label_count == ctx->label_capacity) {
+         int capacity = ctx->label_capacity ? ctx->label_capacity * 2 : 1024;
+         Label* labels = (Label*)realloc(ctx->labels, capacity * sizeof(Label));
+         if (!labels) return -1;
+         ctx->labels = labels;
+         int* queue = (int*)realloc(ctx->label_queue, capacity * sizeof(int));
+         if (!queue) return -1;
+         ctx->label_queue = queue;
+         ctx->label_capacity = capacity;
+     }
+     return ctx->label_count++;
+ }
+ 
+ //queues a label, every label is queued once so the queue never outgrows them
+ void label_queue_push(SearchContext* ctx, int label) {
+     int* queue = ctx->label_queue;
+     Cost key = ctx->labels[label].f_cost;
+     int current = ctx->label_queue_size++;
+     while (current > 0) {
+         int parent = (current - 1) / 2;
+         if (!(key < ctx->labels[queue[parent]].f_cost)) break;
+         queue[current] = queue[parent];
+         current = parent;
+     }
+     queue[current] = label;
+ }
+ 
+ //removes and returns the label with the lowest f cost, -1 if the queue is empty
+ int label_queue_pop(SearchContext* ctx) {
+     if (ctx->label_queue_size == 0) return -1;
+     int* queue = ctx->label_queue;
+     int min = queue[0];
+     int last = queue[--ctx->label_queue_size];
+     Cost key = ctx->labels[last].f_cost;
+     int size = ctx->label_queue_size;
+     int current = 0;
+     while (2*current + 1 < size) {
+         int child = 2*current + 1;
+         if (child + 1 < size && ctx->labels[queue[child + 1]].f_cost < ctx->labels[queue[child]].f_cost) child++;
+         if (!(ctx->labels[queue[child]].f_cost < key)) break;
+         queue[current] = queue[child];
+         current = child;
+     }
+     if (size > 0) queue[current] = last;
+     return min;
+ }
+ 
  //converts minutes since midnight to a formated time string
  //minutes - min since midnight
- //time_str - output buffer for the formated time
+ //time_str - output buffer for the formated time, MAX_TIME_LENGTH characters
  void minutes_to_time(int minutes, char* time_str) {
-    sprintf(time_str, "%02d:%02d", minutes / 60, minutes % 60);
+    //every caller passes a time of the day, kept in range so the text always fits
+    unsigned int minute_of_day = (unsigned int)(minutes % 1440 + 1440) % 1440;
+    snprintf(time_str, MAX_TIME_LENGTH, "%02u:%02u", minute_of_day / 60, minute_of_day % 60);
 }
  
+//the type bits without the in situ and const flags
+ bool is_json_string(const cJSON* item) {
+     return item && (item->type & 0xFF) == cJSON_String;
+ }
+
+ //a cabin size, a number that is not negative
+ bool valid_seat_count(const cJSON* item) {
+     return item && (item->type & 0xFF) == cJSON_Number && item->valuedouble >= 0;
+ }
+
 //checks if the airport code is correct ( according to the IATA code)
  bool validate_airport_code(const char* code) {
      if (strlen(code) != 3) return false;
@@ -178,13 +955,12 @@ void get_next_day(const char* current_day, char* next_day);
      return true;
  }
  
- //parsed the data.json file which is like our small database
- //containing the airports, flights and flights schedules and other
- bool parse_json_input(const char* filename) {
+ //reads a whole file into a null terminated buffer, the caller frees it
+ char* read_file(const char* filename) {
      FILE* file = fopen(filename, "r");
      if (!file) {
          fprintf(stderr, "Error: Cannot open file %s\n", filename);
-         return false;
+         return NULL;
      }
      
      //get the file size for the memory allocation
@@ -197,408 +973,3304 @@ void get_next_day(const char* current_day, char* next_day);
      if (!json_str) {
          fclose(file);
          fprintf(stderr, "Error: Memory allocation failed\n");
-         return false;
+         return NULL;
      }
      
      //read the file into the memory
-     fread(json_str, 1, file_size, file);
-     json_str[file_size] = '\0';
+     size_t read = fread(json_str, 1, file_size, file);
+     json_str[read] = '\0';
      fclose(file);
+     return json_str;
+ }
+ 
+ //converts an amount read from the input to fixed point, to the nearest hundredth
+ Cost cost_from_double(double value) {
+     return (Cost)llround(value * COST_SCALE);
+ }
+ 
+ //and back, for the output
+ double cost_to_double(Cost cost) {
+     return (double)cost / COST_SCALE;
+ }
+ 
+ //fills in a scheduled flight from its route and the schedule of one day
+ //distance is taken from the data when given, otherwise the haversine formula is used
+ void init_scheduled_flight(const Timetable* tt, ScheduledFlight* f, const char* from, const char* to,
+                            const char* day, int departure_time, int arrival_time,
+                            double base_cost, double cost_multiplier, cJSON* distance, cJSON* seats) {
+     strncpy(f->from, from, 3);
+     f->from[3] = '\0';
+     strncpy(f->to, to, 3);
+     f->to[3] = '\0';
+     f->from_index = find_airport_index(tt, f->from);
+     f->to_index = find_airport_index(tt, f->to);
      
-     //parse the json string
-     cJSON* json = cJSON_Parse(json_str);
-     free(json_str);
+     f->departure_time = departure_time;
+     f->arrival_time = arrival_time;
+     f->duration = time_difference(f->departure_time, f->arrival_time);
+     f->base_cost = cost_from_double(base_cost);
+     f->cost = llround(f->base_cost * cost_multiplier);
+     strncpy(f->day_of_week, day, MAX_DAY_LENGTH-1);
+     f->day_of_week[MAX_DAY_LENGTH-1] = '\0';
+     f->available = true;
      
-     if (!json) {
-         fprintf(stderr, "Error: Invalid JSON format\n");
-         return false;
-     }
- 
-     //parsing the airports + validation
-     cJSON* airports_json = cJSON_GetObjectItem(json, "airports");
-     if (!airports_json) {
-         fprintf(stderr, "Error: Missing 'airports' in JSON\n");
-         cJSON_Delete(json);
-         return false;
+     //"seats": {"economy": 150, "business": 30, "first": 8}, any cabin left out gets the default
+     for (int c = 0; c < NUM_CABINS; c++) {
+         cJSON* count = seats ? cJSON_GetObjectItem(seats, cabin_names[c]) : NULL;
+         if (count && !valid_seat_count(count)) {
+             fprintf(stderr, "Warning: Invalid %s seats on %s-%s, the default applies\n", cabin_names[c], from, to);
+             count = NULL;
+         }
+         f->seats[c] = count ? count->valueint : default_cabin_seats[c];
      }
      
-     //process each airport in the array
-     int airport_count = cJSON_GetArraySize(airports_json);
-     for (int i = 0; i < airport_count && num_airports < MAX_AIRPORTS; i++) {
-         cJSON* airport = cJSON_GetArrayItem(airports_json, i);
-         
-         cJSON* code = cJSON_GetObjectItem(airport, "code");
-         cJSON* name = cJSON_GetObjectItem(airport, "name");
-         cJSON* lat = cJSON_GetObjectItem(airport, "latitude");
-         cJSON* lon = cJSON_GetObjectItem(airport, "longitude");
-         
-         //skipping airports with missing data
-         if (!code || !name || !lat || !lon) {
-             fprintf(stderr, "Warning: Incomplete airport data at index %d\n", i);
-             continue;
-         }
-         
-         //making sure the airport code format is right
-         if (!validate_airport_code(code->valuestring)) {
-             fprintf(stderr, "Warning: Invalid airport code '%s'\n", code->valuestring);
-             continue;
-         }
-         
-         //here storing our airport data in the array
-         strncpy(airports[num_airports].code, code->valuestring, 3);
-         airports[num_airports].code[3] = '\0';
-         strncpy(airports[num_airports].name, name->valuestring, 99);
-         airports[num_airports].name[99] = '\0';
-         airports[num_airports].lat = lat->valuedouble;
-         airports[num_airports].lon = lon->valuedouble;
-         
-         //get the min waiting time specific for the airport, or use the default time
-         cJSON* min_wait = cJSON_GetObjectItem(airport, "min_waiting_time");
-         airports[num_airports].min_waiting_time = min_wait ? min_wait->valueint : connection_time_required;
-         
-         num_airports++;
+     if (distance) {
+         f->distance = distance->valuedouble;
+     } else if (f->from_index >= 0 && f->to_index >= 0) {
+         //calculating distance useing the haversine formula
+         f->distance = calculate_distance(
+             tt->airports[f->from_index].lat, tt->airports[f->from_index].lon,
+             tt->airports[f->to_index].lat, tt->airports[f->to_index].lon
+         );
+     } else {
+         f->distance = 0;
+         fprintf(stderr, "Warning: Couldn't calculate distance for flight %s-%s\n", f->from, f->to);
      }
+ }
  
-     //here parsing the flights section with validation
-     cJSON* flights_json = cJSON_GetObjectItem(json, "flights");
-     if (!flights_json) {
-         fprintf(stderr, "Error: Missing 'flights' in JSON\n");
-         cJSON_Delete(json);
+ //departure of a flight in minutes from monday 00:00
+ int flight_minute_of_week(const ScheduledFlight* f) {
+     return find_day_index(f->day_of_week) * 1440 + f->departure_time;
+ }
+ 
+ //arrival of a flight in minutes from monday 00:00, overnight flights land the day after
+ int flight_arrival_minute_of_week(const ScheduledFlight* f) {
+     return (flight_minute_of_week(f) + f->duration) % MINUTES_PER_WEEK;
+ }
+ 
+ int compare_departures(const void* a, const void* b) {
+     const Departure* x = (const Departure*)a;
+     const Departure* y = (const Departure*)b;
+     if (x->minute_of_week != y->minute_of_week) return x->minute_of_week < y->minute_of_week ? -1 : 1;
+     return (x->flight_index > y->flight_index) - (x->flight_index < y->flight_index);
+ }
+ 
+ //position of the first departure at or after minute_of_week
+ int departure_index_lower_bound(const DepartureList* list, int minute_of_week) {
+     int lo = 0, hi = list->count;
+     while (lo < hi) {
+         int mid = (lo + hi) / 2;
+         if (list->flights[mid].minute_of_week < minute_of_week) lo = mid + 1;
+         else hi = mid;
+     }
+     return lo;
+ }
+ 
+ bool departure_index_reserve(DepartureList* list) {
+     if (list->count < list->capacity) return true;
+     int capacity = list->capacity ? list->capacity * 2 : 8;
+     Departure* grown = (Departure*)realloc(list->flights, capacity * sizeof(Departure));
+     if (!grown) {
+         fprintf(stderr, "Error: Memory allocation failed\n");
          return false;
      }
+     list->flights = grown;
+     list->capacity = capacity;
+     return true;
+ }
  
-     //processing each flight in the array
-     int flight_count = cJSON_GetArraySize(flights_json);
-     for (int i = 0; i < flight_count && num_flights < MAX_FLIGHTS; i++) {
-         cJSON* flight_info = cJSON_GetArrayItem(flights_json, i);
-         
-         //extracting flight properties
-         cJSON* from = cJSON_GetObjectItem(flight_info, "from");
-         cJSON* to = cJSON_GetObjectItem(flight_info, "to");
-         cJSON* base_cost = cJSON_GetObjectItem(flight_info, "base_cost");
-         cJSON* schedule = cJSON_GetObjectItem(flight_info, "schedule");
-         
-         //skiping flights with missing data
-         if (!from || !to || !base_cost || !schedule) {
-             fprintf(stderr, "Warning: Incomplete flight data at index %d\n", i);
-             continue;
-         }
-         
-         //here also we make sure the airport code is right
-         if (!validate_airport_code(from->valuestring) || !validate_airport_code(to->valuestring)) {
-             fprintf(stderr, "Warning: Invalid airport codes in flight %d\n", i);
-             continue;
+ //inserts a flight into a list, in order
+ bool departure_index_insert(DepartureList* list, int minute_of_week, int flight_index) {
+     if (!departure_index_reserve(list)) return false;
+     Departure d = {minute_of_week, flight_index};
+     int k = list->count;
+     while (k > 0 && compare_departures(&list->flights[k - 1], &d) > 0) k--;
+     memmove(&list->flights[k + 1], &list->flights[k], (list->count - k) * sizeof(Departure));
+     list->flights[k] = d;
+     list->count++;
+     return true;
+ }
+ 
+ //takes a flight out of a list
+ void departure_index_erase(DepartureList* list, int flight_index) {
+     for (int k = 0; k < list->count; k++) {
+         if (list->flights[k].flight_index == flight_index) {
+             memmove(&list->flights[k], &list->flights[k + 1], (list->count - k - 1) * sizeof(Departure));
+             list->count--;
+             return;
          }
+     }
+ }
  
-         //processing the schedule for each day of the week
-         //form monday to sunday
-         for (int day = 0; day < 7; day++) {
-             cJSON* day_schedule = cJSON_GetObjectItem(schedule, days_of_week[day]);
-             if (!day_schedule) continue;
-             
-             //extracting schedule details
-             cJSON* departure = cJSON_GetObjectItem(day_schedule, "departure_time");
-             cJSON* arrival = cJSON_GetObjectItem(day_schedule, "arrival_time");
-             cJSON* cost_multiplier = cJSON_GetObjectItem(day_schedule, "cost_multiplier");
-             cJSON* available = cJSON_GetObjectItem(day_schedule, "available");
-             
-             //skip if the schedule is incomplete
-             if (!departure || !arrival || !cost_multiplier || !available) {
-                 fprintf(stderr, "Warning: Incomplete schedule for %s\n", days_of_week[day]);
-                 continue;
-             }
-             
-             //only add the flight if it is available
-             if (available->valueint || available->type == cJSON_True) {
-                 ScheduledFlight* f = &flights[num_flights];
-                 
-                 //storing the flight data
-                 strncpy(f->from, from->valuestring, 3);
-                 f->from[3] = '\0';
-                 strncpy(f->to, to->valuestring, 3);
-                 f->to[3] = '\0';
-                 
-                 f->departure_time = time_to_minutes(departure->valuestring);
-                 f->arrival_time = time_to_minutes(arrival->valuestring);
-                 f->duration = time_difference(f->departure_time, f->arrival_time);
-                 f->cost = base_cost->valuedouble * cost_multiplier->valuedouble;
-                 strncpy(f->day_of_week, days_of_week[day], MAX_DAY_LENGTH-1);
-                 f->available = true;
-                 
-                 //get the distance if it is provided or it needs to calculate it 
-                 cJSON* distance = cJSON_GetObjectItem(flight_info, "distance");
-                 if (distance) {
-                     f->distance = distance->valuedouble;
-                 } else {
-
-                     //calculating distance useing the haversine formula
-                     int from_idx = find_airport_index(f->from);
-                     int to_idx = find_airport_index(f->to);
-                     
-                     if (from_idx >= 0 && to_idx >= 0) {
-                         f->distance = calculate_distance(
-                             airports[from_idx].lat, airports[from_idx].lon,
-                             airports[to_idx].lat, airports[to_idx].lon
-                         );
-                     } else {
-                         f->distance = 0;
-                         fprintf(stderr, "Warning: Couldn't calculate distance for flight %d\n", num_flights);
-                     }
-                 }
-                 
-                 num_flights++;
-                 if (num_flights >= MAX_FLIGHTS) break;
+ //inserts a flight into the departure list of its origin airport
+ bool departure_index_add(Timetable* tt, int airport_index, int flight_index) {
+     return departure_index_insert(&tt->departures[airport_index],
+                                   flight_minute_of_week(&tt->flights[flight_index]), flight_index);
+ }
+ 
+ //takes a flight out of the departure list of its origin airport
+ void departure_index_remove(Timetable* tt, int airport_index, int flight_index) {
+     departure_index_erase(&tt->departures[airport_index], flight_index);
+ }
+ 
+ //the same for the arrival list of its destination airport
+ bool arrival_index_add(Timetable* tt, int airport_index, int flight_index) {
+     return departure_index_insert(&tt->arrivals[airport_index],
+                                   flight_arrival_minute_of_week(&tt->flights[flight_index]), flight_index);
+ }
+ 
+ void arrival_index_remove(Timetable* tt, int airport_index, int flight_index) {
+     departure_index_erase(&tt->arrivals[airport_index], flight_index);
+ }
+ 
+ //appends a flight to a list that is sorted once it is complete
+ bool departure_index_append(DepartureList* list, int minute_of_week, int flight_index) {
+     if (!departure_index_reserve(list)) return false;
+     list->flights[list->count].minute_of_week = minute_of_week;
+     list->flights[list->count].flight_index = flight_index;
+     list->count++;
+     return true;
+ }
+ 
+ //rebuilds the departure and arrival lists of all airports from the flights array
+ bool build_departure_index(Timetable* tt) {
+     for (int i = 0; i < MAX_AIRPORTS; i++) {
+         tt->departures[i].count = 0;
+         tt->arrivals[i].count = 0;
+     }
+     for (int i = 0; i < tt->num_flights; i++) {
+         const ScheduledFlight* f = &tt->flights[i];
+         if (f->from_index >= 0 &&
+             !departure_index_append(&tt->departures[f->from_index], flight_minute_of_week(f), i))
+             return false;
+         if (f->to_index >= 0 &&
+             !departure_index_append(&tt->arrivals[f->to_index], flight_arrival_minute_of_week(f), i))
+             return false;
+     }
+     //an airport without flights has no array to sort
+     for (int i = 0; i < MAX_AIRPORTS; i++) {
+         if (tt->departures[i].count > 1)
+             qsort(tt->departures[i].flights, tt->departures[i].count, sizeof(Departure), compare_departures);
+         if (tt->arrivals[i].count > 1)
+             qsort(tt->arrivals[i].flights, tt->arrivals[i].count, sizeof(Departure), compare_departures);
+     }
+     return true;
+ }
+ 
+ /* the flights of a departure list a traveller who arrived at arrival_time on
+ day arrival_day (an index into days_of_week) can connect to, by the rule of
+ is_connection_possible: the flights of the same day from arrival_time +
+ min_connection on and every flight of the other days
+ they are taken one day at a time, offset days after the arrival day, as
+ the range [*begin, *end) of the list, offset 0 is the arrival day itself
+ in a range the wait before the flight only grows, so a search can stop at
+ the first flight that waits too long
+ the arrival day has to be a day, the searches reject a start day that is
+ not one before they begin
+*/
+ void connection_day_range(const DepartureList* list, int arrival_day, int offset, int arrival_time,
+                           int min_connection, int* begin, int* end) {
+     int day = (arrival_day + offset) % 7;
+     int earliest = 0;
+     if (offset == 0) {
+         earliest = arrival_time + min_connection;
+         if (earliest < 0) earliest = 0;
+         if (earliest > 1440) earliest = 1440;
+     }
+     *begin = departure_index_lower_bound(list, day * 1440 + earliest);
+     *end = departure_index_lower_bound(list, (day + 1) * 1440);
+ }
+ 
+ //name of a day index, an empty string that matches no day for -1
+ const char* day_name(int day) {
+     return day >= 0 ? days_of_week[day] : "";
+ }
+ 
+ //day index a flight lands on, the next day if it lands after midnight
+ int flight_arrival_day(const ScheduledFlight* f, int minute_of_week) {
+     int day = minute_of_week / 1440;
+     return f->arrival_time < f->departure_time ? (day + 1) % 7 : day;
+ }
+ 
+ //drops a reference to a ledger, the last one frees its blocks
+ void seat_ledger_release(SeatLedger* ledger) {
+     if (!ledger || atomic_fetch_sub(&ledger->refcount, 1) != 1) return;
+     for (int b = 0; b < (MAX_FLIGHTS + SEAT_BLOCK_SIZE - 1) / SEAT_BLOCK_SIZE; b++) {
+         free(atomic_load(&ledger->blocks[b]));
+     }
+     free(ledger);
+ }
+ 
+ //allocates an empty timetable with a ledger of its own, the caller owns the
+ //only reference
+ Timetable* timetable_create(void) {
+     Timetable* tt = (Timetable*)calloc(1, sizeof(Timetable));
+     SeatLedger* ledger = (SeatLedger*)calloc(1, sizeof(SeatLedger));
+     if (!tt || !ledger) {
+         fprintf(stderr, "Error: Memory allocation failed\n");
+         free(tt);
+         free(ledger);
+         return NULL;
+     }
+     atomic_init(&ledger->refcount, 1);
+     tt->seats_sold = ledger;
+     tt->connection_time_required = 60;
+     tt->version = atomic_fetch_add(&timetable_versions, 1) + 1;
+     atomic_init(&tt->refcount, 1);
+     return tt;
+ }
+ 
+ //drops a reference, the last one frees the timetable
+ void timetable_release(Timetable* tt) {
+     if (!tt || atomic_fetch_sub(&tt->refcount, 1) != 1) return;
+     for (int i = 0; i < MAX_AIRPORTS; i++) {
+         free(tt->departures[i].flights);
+         free(tt->arrivals[i].flights);
+     }
+     seat_ledger_release(tt->seats_sold);
+     free(tt->flights);
+     free(tt);
+ }
+ 
+ //makes room for at least count flights in a timetable that is not published yet
+ bool timetable_reserve_flights(Timetable* tt, int count) {
+     if (count <= tt->flight_capacity) return true;
+     int capacity = tt->flight_capacity ? tt->flight_capacity : 64;
+     while (capacity < count) capacity *= 2;
+     ScheduledFlight* grown = (ScheduledFlight*)realloc(tt->flights, capacity * sizeof(ScheduledFlight));
+     if (!grown) {
+         fprintf(stderr, "Error: Memory allocation failed\n");
+         return false;
+     }
+     tt->flights = grown;
+     tt->flight_capacity = capacity;
+     return true;
+ }
+ 
+ //copies a timetable so it can be changed before it is published,
+ //the copy keeps the flight indices, so it shares the ledger of the base
+ Timetable* timetable_clone(const Timetable* base) {
+     Timetable* tt = timetable_create();
+     if (!tt) return NULL;
+     seat_ledger_release(tt->seats_sold);
+     long long version = tt->version;
+     memcpy(tt, base, sizeof(Timetable));
+     tt->version = version;
+     atomic_fetch_add(&tt->seats_sold->refcount, 1);
+     atomic_init(&tt->refcount, 1);
+     memset(tt->departures, 0, sizeof(tt->departures));
+     memset(tt->arrivals, 0, sizeof(tt->arrivals));
+     tt->flights = NULL;
+     tt->flight_capacity = 0;
+     if (!timetable_reserve_flights(tt, base->num_flights)) {
+         timetable_release(tt);
+         return NULL;
+     }
+     memcpy(tt->flights, base->flights, base->num_flights * sizeof(ScheduledFlight));
+     //the lists of the base are already sorted, so they are copied as they are
+     for (int i = 0; i < 2 * MAX_AIRPORTS; i++) {
+         const DepartureList* from = i < MAX_AIRPORTS ? &base->departures[i] : &base->arrivals[i - MAX_AIRPORTS];
+         DepartureList* list = i < MAX_AIRPORTS ? &tt->departures[i] : &tt->arrivals[i - MAX_AIRPORTS];
+         if (from->count == 0) continue;
+         list->flights = (Departure*)malloc(from->count * sizeof(Departure));
+         if (!list->flights) {
+             fprintf(stderr, "Error: Memory allocation failed\n");
+             timetable_release(tt);
+             return NULL;
+         }
+         memcpy(list->flights, from->flights, from->count * sizeof(Departure));
+         list->count = list->capacity = from->count;
+     }
+     return tt;
+ }
+ 
+ //every thread but the one running the server loop calls this first, so
+ //the stop and stats signals are taken by the loop, which they wake from
+ //epoll_wait, and never by a thread that would leave them unseen
+ void block_server_signals(void) {
+ #ifdef __linux__
+     sigset_t signals;
+     sigemptyset(&signals);
+     sigaddset(&signals, SIGINT);
+     sigaddset(&signals, SIGTERM);
+     sigaddset(&signals, SIGUSR1);
+     pthread_sigmask(SIG_BLOCK, &signals, NULL);
+ #endif
+ }
+ 
+ //lets another thread run, for the waits on a reader that is about to finish
+ void yield_thread(void) {
+ #ifdef _WIN32
+     SwitchToThread();
+ #else
+     sched_yield();
+ #endif
+ }
+ 
+ //returns the side of the gate the reader is counted on, see ReaderGate
+ int reader_gate_enter(ReaderGate* gate) {
+     int side = atomic_load(&gate->side);
+     atomic_fetch_add(&gate->readers[side], 1);
+     return side;
+ }
+ 
+ void reader_gate_leave(ReaderGate* gate, int side) {
+     atomic_fetch_sub(&gate->readers[side], 1);
+ }
+ 
+ //called once the new pointer is published, a reader that comes in after the
+ //side turns loads the new one, and the ones counted before take their
+ //reference to the old one within a few instructions, the cpu is given up in
+ //case one was preempted in the window
+ void reader_gate_wait(ReaderGate* gate) {
+     int side = atomic_fetch_xor(&gate->side, 1);
+     while (atomic_load(&gate->readers[side]) > 0) {
+         yield_thread();
+     }
+ }
+ 
+ //returns a reference to the published timetable, or NULL if nothing is loaded
+ //never blocks, the reference has to be given back with timetable_release
+ Timetable* timetable_acquire(void) {
+     //while we are counted at the gate the publisher keeps its reference to
+     //the snapshot we may have loaded, so it cannot be freed before we take our own
+     int side = reader_gate_enter(&timetable_readers);
+     Timetable* tt = atomic_load(&current_timetable);
+     if (tt) atomic_fetch_add(&tt->refcount, 1);
+     reader_gate_leave(&timetable_readers, side);
+     return tt;
+ }
+ 
+ //makes tt the timetable seen by new searches, taking over the caller's reference
+ //searches still running on the old snapshot keep it alive until they release it
+ //a timetable loaded anew over the published one takes over its seats sold,
+ //with the bookings held off while they are counted, see booking_lock
+ void timetable_publish(Timetable* tt) {
+     pthread_mutex_lock(&publish_lock);
+     Timetable* current = atomic_load(&current_timetable);
+     bool carry_over = current && tt && current->seats_sold != tt->seats_sold;
+     if (carry_over) {
+         pthread_rwlock_wrlock(&booking_lock);
+         seat_ledger_carry_over(current, tt);
+     }
+     Timetable* old = atomic_exchange(&current_timetable, tt);
+     if (carry_over) pthread_rwlock_unlock(&booking_lock);
+     reader_gate_wait(&timetable_readers);
+     pthread_mutex_unlock(&publish_lock);
+     timetable_release(old);
+ }
+ 
+ //the published timetable for a booking, which keeps publishers from carrying
+ //the seats sold over until timetable_release_booking, NULL if nothing is loaded
+ Timetable* timetable_acquire_booking(void) {
+     pthread_rwlock_rdlock(&booking_lock);
+     Timetable* tt = timetable_acquire();
+     if (!tt) pthread_rwlock_unlock(&booking_lock);
+     return tt;
+ }
+ 
+ void timetable_release_booking(Timetable* tt) {
+     timetable_release(tt);
+     pthread_rwlock_unlock(&booking_lock);
+ }
+ 
+ //the sold counter of a flight and cabin in the ledger of tt, the block is
+ //allocated if create is set, returns NULL if the flight has no block, or it
+ //could not be allocated
+ atomic_int* seat_counter(const Timetable* tt, int flight_index, CabinClass cabin, bool create) {
+     _Atomic(SeatBlock*)* slot = &tt->seats_sold->blocks[flight_index / SEAT_BLOCK_SIZE];
+     SeatBlock* block = atomic_load(slot);
+     if (!block && create) {
+         SeatBlock* fresh = (SeatBlock*)calloc(1, sizeof(SeatBlock));
+         if (!fresh) {
+             fprintf(stderr, "Error: Memory allocation failed\n");
+             return NULL;
+         }
+         //another thread may have got there first, then we use its block
+         if (atomic_compare_exchange_strong(slot, &block, fresh)) block = fresh;
+         else free(fresh);
+     }
+     return block ? &block->sold[flight_index % SEAT_BLOCK_SIZE][cabin] : NULL;
+ }
+ 
+ int seats_remaining(const Timetable* tt, int flight_index, CabinClass cabin) {
+     atomic_int* sold = seat_counter(tt, flight_index, cabin, false);
+     int taken = sold ? atomic_load_explicit(sold, memory_order_relaxed) : 0;
+     return tt->flights[flight_index].seats[cabin] - taken;
+ }
+ 
+ //true if no cabin has a seat left, checked by the search for every flight it looks at
+ bool flight_sold_out(const Timetable* tt, int flight_index) {
+     SeatBlock* block = atomic_load_explicit(&tt->seats_sold->blocks[flight_index / SEAT_BLOCK_SIZE], memory_order_acquire);
+     const ScheduledFlight* f = &tt->flights[flight_index];
+     for (int c = 0; c < NUM_CABINS; c++) {
+         int taken = block ? atomic_load_explicit(&block->sold[flight_index % SEAT_BLOCK_SIZE][c], memory_order_relaxed) : 0;
+         if (f->seats[c] > taken) return false;
+     }
+     return true;
+ }
+ 
+ //takes seats on one flight if that many are left, a compare and swap loop
+ //so concurrent bookings of the same flight never sell more than its seats
+ bool reserve_flight_seats(const Timetable* tt, int flight_index, CabinClass cabin, int seats) {
+     atomic_int* sold = seat_counter(tt, flight_index, cabin, true);
+     if (!sold) return false;
+     int capacity = tt->flights[flight_index].seats[cabin];
+     int taken = atomic_load(sold);
+     do {
+         //written so it cannot overflow, seats comes from the client
+         if (seats > capacity - taken) return false;
+     } while (!atomic_compare_exchange_weak(sold, &taken, taken + seats));
+     return true;
+ }
+ 
+ //gives seats on one flight back, a compare and swap loop like the reserve,
+ //false if fewer than that many are sold, then nothing is given back
+ bool release_flight_seats(const Timetable* tt, int flight_index, CabinClass cabin, int seats) {
+     atomic_int* sold = seat_counter(tt, flight_index, cabin, false);
+     if (!sold || seats <= 0) return false;
+     int taken = atomic_load(sold);
+     do {
+         if (seats > taken) return false;
+     } while (!atomic_compare_exchange_weak(sold, &taken, taken - seats));
+     return true;
+ }
+ 
+ /* books the same number of seats in one cabin on every flight of an itinerary
+ all or nothing: the flights are taken one after another and if one of them
+ is full the ones already taken are given back, so a failed booking holds
+ nothing once it returns (a booking running at the same time may see those
+ seats taken for that short while)
+ no lock is involved, each flight is one compare and swap
+*/
+ bool reserve_seats(const Timetable* tt, const int* flights, int count, CabinClass cabin, int seats) {
+     if (seats <= 0 || cabin < ECONOMY || cabin >= NUM_CABINS) return false;
+     for (int i = 0; i < count; i++) {
+         if (flights[i] < 0 || flights[i] >= tt->num_flights ||
+             !reserve_flight_seats(tt, flights[i], cabin, seats)) {
+             for (int j = 0; j < i; j++) {
+                 release_flight_seats(tt, flights[j], cabin, seats);
              }
+             return false;
          }
      }
+     return true;
+ }
  
-     //parse the configuration section of the json if it is present
-     cJSON* config = cJSON_GetObjectItem(json, "config");
-     if (config) {
-         cJSON* conn_time = cJSON_GetObjectItem(config, "min_connection_time");
-         if (conn_time) connection_time_required = conn_time->valueint;
+ //gives back the seats of a booking made with reserve_seats, all or nothing
+ //like the reserve: false if a flight has fewer seats sold, the flights
+ //already given back are taken again then, so nothing is released
+ bool release_seats(const Timetable* tt, const int* flights, int count, CabinClass cabin, int seats) {
+     if (seats <= 0 || cabin < ECONOMY || cabin >= NUM_CABINS) return false;
+     for (int i = 0; i < count; i++) {
+         if (flights[i] < 0 || flights[i] >= tt->num_flights ||
+             !release_flight_seats(tt, flights[i], cabin, seats)) {
+             for (int j = 0; j < i; j++) {
+                 atomic_fetch_add(seat_counter(tt, flights[j], cabin, false), seats);
+             }
+             return false;
+         }
      }
+     return true;
+ }
+ 
+ //turns one entry of the flights array into a scheduled flight per available day
+ //and appends them to the chunk, the timetable is only read
+ void parse_flight_entry(FlightChunk* chunk, cJSON* flight_info, int i) {
+     //extracting flight properties
+     cJSON* from = cJSON_GetObjectItem(flight_info, "from");
+     cJSON* to = cJSON_GetObjectItem(flight_info, "to");
+     cJSON* base_cost = cJSON_GetObjectItem(flight_info, "base_cost");
+     cJSON* schedule = cJSON_GetObjectItem(flight_info, "schedule");
      
-     //clean up the json parser
-     cJSON_Delete(json);
+     //skiping flights with missing data
+     if (!from || !to || !base_cost || !schedule) {
+         fprintf(stderr, "Warning: Incomplete flight data at index %d\n", i);
+         return;
+     }
      
-     //check if we found any valid airports and flights
-     if (num_airports == 0 || num_flights == 0) {
-         fprintf(stderr, "Error: No valid airports or flights found\n");
+     //here also we make sure the airport code is right
+     if (!validate_airport_code(from->valuestring) || !validate_airport_code(to->valuestring)) {
+         fprintf(stderr, "Warning: Invalid airport codes in flight %d\n", i);
+         return;
+     }
+ 
+     //processing the schedule for each day of the week
+     //form monday to sunday
+     for (int day = 0; day < 7; day++) {
+         cJSON* day_schedule = cJSON_GetObjectItem(schedule, days_of_week[day]);
+         if (!day_schedule) continue;
+         
+         //extracting schedule details
+         cJSON* departure = cJSON_GetObjectItem(day_schedule, "departure_time");
+         cJSON* arrival = cJSON_GetObjectItem(day_schedule, "arrival_time");
+         cJSON* cost_multiplier = cJSON_GetObjectItem(day_schedule, "cost_multiplier");
+         cJSON* available = cJSON_GetObjectItem(day_schedule, "available");
+         
+         //skip if the schedule is incomplete
+         if (!departure || !arrival || !cost_multiplier || !available) {
+             fprintf(stderr, "Warning: Incomplete schedule for %s\n", days_of_week[day]);
+             continue;
+         }
+         
+         //only add the flight if it is available
+         if (available->valueint || available->type == cJSON_True) {
+             if (chunk->num_flights == chunk->capacity) {
+                 int capacity = chunk->capacity ? chunk->capacity * 2 : 64;
+                 ScheduledFlight* grown = (ScheduledFlight*)realloc(chunk->flights, capacity * sizeof(ScheduledFlight));
+                 if (!grown) {
+                     fprintf(stderr, "Error: Memory allocation failed\n");
+                     chunk->failed = true;
+                     return;
+                 }
+                 chunk->flights = grown;
+                 chunk->capacity = capacity;
+             }
+             
+             //storing the flight data, the distance is used if it is provided
+             init_scheduled_flight(chunk->tt, &chunk->flights[chunk->num_flights], from->valuestring, to->valuestring,
+                                   days_of_week[day],
+                                   time_to_minutes(departure->valuestring),
+                                   time_to_minutes(arrival->valuestring),
+                                   base_cost->valuedouble, cost_multiplier->valuedouble,
+                                   cJSON_GetObjectItem(flight_info, "distance"),
+                                   cJSON_GetObjectItem(flight_info, "seats"));
+             chunk->num_flights++;
+         }
+     }
+ }
+ 
+ //thread entry point, parses every entry of one chunk
+ void* parse_flight_chunk(void* arg) {
+     FlightChunk* chunk = (FlightChunk*)arg;
+     AllocSite previous_site = alloc_site_enter(ALLOC_LOADER);
+     for (int k = 0; k < chunk->count && !chunk->failed; k++) {
+         parse_flight_entry(chunk, chunk->entries[k], chunk->first + k);
+     }
+     alloc_site_leave(previous_site);
+     return NULL;
+ }
+ 
+ //number of threads used to parse the flights, small timetables are not
+ //worth starting threads for
+ int count_loader_threads(int flight_count) {
+ #ifdef _WIN32
+     SYSTEM_INFO info;
+     GetSystemInfo(&info);
+     int cpus = (int)info.dwNumberOfProcessors;
+ #else
+     int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+ #endif
+     int threads = flight_count / MIN_FLIGHTS_PER_LOADER;
+     if (threads > cpus) threads = cpus;
+     return threads > 1 ? threads : 1;
+ }
+ 
+ /* parses the flights array into the timetable
+ every entry is independent, so the array is split into one contiguous slice
+ per thread and each thread builds its own chunk of flights
+ the chunks are then joined in slice order, which gives exactly the
+ flights array a single thread would have built
+ */
+ bool parse_flights_parallel(Timetable* tt, cJSON** entries, int flight_count) {
+     int num_threads = count_loader_threads(flight_count);
+     FlightChunk* chunks = (FlightChunk*)calloc(num_threads, sizeof(FlightChunk));
+     pthread_t* threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+     bool* started = (bool*)calloc(num_threads, sizeof(bool));
+     if (!chunks || !threads || !started) {
+         fprintf(stderr, "Error: Memory allocation failed\n");
+         free(chunks);
+         free(threads);
+         free(started);
          return false;
      }
      
-     return true;
+     for (int t = 0; t < num_threads; t++) {
+         chunks[t].tt = tt;
+         chunks[t].first = (int)((long long)flight_count * t / num_threads);
+         chunks[t].count = (int)((long long)flight_count * (t + 1) / num_threads) - chunks[t].first;
+         chunks[t].entries = entries + chunks[t].first;
+     }
+     
+     //the first chunk is parsed on this thread, if a thread cannot be
+     //started its chunk is parsed here as well
+     for (int t = 1; t < num_threads; t++) {
+         started[t] = pthread_create(&threads[t], NULL, parse_flight_chunk, &chunks[t]) == 0;
+     }
+     parse_flight_chunk(&chunks[0]);
+     for (int t = 1; t < num_threads; t++) {
+         if (started[t]) pthread_join(threads[t], NULL);
+         else parse_flight_chunk(&chunks[t]);
+     }
+     
+     //joining the chunks in order, keeping at most MAX_FLIGHTS flights
+     bool ok = true;
+     int total = 0;
+     for (int t = 0; t < num_threads; t++) {
+         if (chunks[t].failed) ok = false;
+         total += chunks[t].num_flights;
+     }
+     if (total > MAX_FLIGHTS) total = MAX_FLIGHTS;
+     if (ok && !timetable_reserve_flights(tt, total)) ok = false;
+     for (int t = 0; ok && t < num_threads && tt->num_flights < total; t++) {
+         int count = chunks[t].num_flights;
+         if (count > total - tt->num_flights) count = total - tt->num_flights;
+         memcpy(&tt->flights[tt->num_flights], chunks[t].flights, count * sizeof(ScheduledFlight));
+         tt->num_flights += count;
+     }
+     
+     for (int t = 0; t < num_threads; t++) {
+         free(chunks[t].flights);
+     }
+     free(chunks);
+     free(threads);
+     free(started);
+     return ok;
  }
  
- /* Implements the A* algorithm in order to find the optimal path between 2 airports
- it uses the priority queue data structure for better performance
- start_code and goal_code -> mean the code of the starting airport and
- the code of the destination airport
- also departure time is in minutes after midnight
- path stored the flight indices in the optimal path
- path_size stores the number of flights in the path
-  */
- bool find_optimal_path(const char* start_code, const char* goal_code, 
-                       const char* start_day, int departure_time, 
-                       RouteType route_type, int* path, int* path_size) {
-     //finding indices of the airports                   
-     int start_index = find_airport_index(start_code);
-     int goal_index = find_airport_index(goal_code);
+ //parsed the data.json file which is like our small database
+ //containing the airports, flights and flights schedules and other
+ //returns a new timetable that is not published yet, or NULL on errors
+ Timetable* parse_timetable_file(const char* filename) {
+     char* json_str = read_file(filename);
+     if (!json_str) return NULL;
      
-     //validating airport codes
-     if (start_index < 0 || goal_index < 0) {
-         fprintf(stderr, "Error: Invalid airport codes (%s or %s not found)\n", 
-                 start_code, goal_code);
-         return false;
+     Timetable* tt = timetable_create();
+     if (!tt) {
+         free(json_str);
+         return NULL;
+     }
+     
+     //parse the json string in place, the strings of the tree point into json_str
+     //so the buffer is only freed after cJSON_Delete
+     cJSON* json = cJSON_ParseInSitu(json_str);
+     
+     if (!json) {
+         fprintf(stderr, "Error: Invalid JSON format\n");
+         free(json_str);
+         timetable_release(tt);
+         return NULL;
      }
  
-     //initializing the data structures necessary for the A* algorithm
-     bool* closed_set = (bool*)calloc(num_airports, sizeof(bool));
-     PriorityQueue open_set;
-     pq_init(&open_set);
-     
-     //tracks the best paths to each airport
-     double* best_cost = (double*)malloc(num_airports * sizeof(double));
-     int* best_parent = (int*)malloc(num_airports * sizeof(int));
-     int* best_flight = (int*)malloc(num_airports * sizeof(int));
-     int* best_arrival_time = (int*)malloc(num_airports * sizeof(int));
-     char** best_arrival_day = (char**)malloc(num_airports * sizeof(char*));
-     
-     //initializing the tracking arrays
-     for (int i = 0; i < num_airports; i++) {
-         best_cost[i] = INFINITY_COST;
-         best_parent[i] = -1;
-         best_flight[i] = -1;
-         best_arrival_time[i] = -1;
-         best_arrival_day[i] = (char*)malloc(MAX_DAY_LENGTH * sizeof(char));
-         strcpy(best_arrival_day[i], "");
-     }
-     
-     //create and enqueue start node
-     Node* start_node = (Node*)malloc(sizeof(Node));
-     start_node->airport_index = start_index;
-     start_node->g_cost = 0.0;
-     start_node->h_cost = heuristic(start_index, goal_index, route_type);
-     start_node->f_cost = start_node->g_cost + start_node->h_cost;
-     start_node->parent_index = -1;
-     start_node->flight_index = -1;
-     start_node->arrival_time = departure_time;
-     strncpy(start_node->arrival_day, start_day, MAX_DAY_LENGTH-1);
-     
-     //initialize the best values for the starting airport
-     best_cost[start_index] = 0.0;
-     best_arrival_time[start_index] = departure_time;
-     strcpy(best_arrival_day[start_index], start_day);
-     
-     //add the start node to the open set
-     pq_enqueue(&open_set, start_node);
-     
-     bool path_found = false;
-     //for safety reasons to avoid infinite loops
-     int expanded_nodes = 0;
-     
-     //the main loop of the A* algorithm
-     while (open_set.size > 0 && expanded_nodes < 10000) {
-         Node* current = pq_dequeue(&open_set);
-         expanded_nodes++;
+     //parsing the airports + validation
+     cJSON* airports_json = cJSON_GetObjectItem(json, "airports");
+     if (!airports_json) {
+         fprintf(stderr, "Error: Missing 'airports' in JSON\n");
+         cJSON_Delete(json);
+         free(json_str);
+         timetable_release(tt);
+         return NULL;
+     }
+     
+     //process each airport in the array
+     int airport_count = cJSON_GetArraySize(airports_json);
+     for (int i = 0; i < airport_count && tt->num_airports < MAX_AIRPORTS; i++) {
+         cJSON* airport = cJSON_GetArrayItem(airports_json, i);
          
-         //check if we reached the goal
-         if (current->airport_index == goal_index) {
-            //reconstruct the path
-             int current_airport = goal_index;
-             int index = 0;
-             
-             while (current_airport != start_index && index < MAX_PATH) {
-                 path[index++] = best_flight[current_airport];
-                 current_airport = best_parent[current_airport];
-             }
-             
-             //check if the path was reconstructed successfully
-             if (current_airport == start_index) {
-                //reverse the path, because at the moment it is from goal to start
-                 for (int i = 0; i < index / 2; i++) {
-                     int temp = path[i];
-                     path[i] = path[index - i - 1];
-                     path[index - i - 1] = temp;
-                 }
-                 *path_size = index;
-                 path_found = true;
-             } else {
-                 fprintf(stderr, "Error: Path reconstruction failed\n");
-             }
-             
-             free(current);
-             break;
+         cJSON* code = cJSON_GetObjectItem(airport, "code");
+         cJSON* name = cJSON_GetObjectItem(airport, "name");
+         cJSON* lat = cJSON_GetObjectItem(airport, "latitude");
+         cJSON* lon = cJSON_GetObjectItem(airport, "longitude");
+         
+         //skipping airports with missing data
+         if (!code || !name || !lat || !lon) {
+             fprintf(stderr, "Warning: Incomplete airport data at index %d\n", i);
+             continue;
          }
          
-         //skip if this airport has been visited fully
-         if (closed_set[current->airport_index]) {
-             free(current);
+         //making sure the airport code format is right
+         if (!validate_airport_code(code->valuestring)) {
+             fprintf(stderr, "Warning: Invalid airport code '%s'\n", code->valuestring);
              continue;
          }
          
-         //mark the current airport as visited
-         closed_set[current->airport_index] = true;
+         //here storing our airport data in the array
+         strncpy(tt->airports[tt->num_airports].code, code->valuestring, 3);
+         tt->airports[tt->num_airports].code[3] = '\0';
+         strncpy(tt->airports[tt->num_airports].name, name->valuestring, 99);
+         tt->airports[tt->num_airports].name[99] = '\0';
+         tt->airports[tt->num_airports].lat = lat->valuedouble;
+         tt->airports[tt->num_airports].lon = lon->valuedouble;
          
-         //explore neightbours, possible flights from the current airport
-         for (int i = 0; i < num_flights; i++) {
-             if (strcmp(flights[i].from, airports[current->airport_index].code) != 0)
-                 continue;
-                 
-            //find the destination airport index
-             int next_index = find_airport_index(flights[i].to);
-             //skip if the destination not found or is already fully visited
-             if (next_index < 0 || closed_set[next_index])
-                 continue;
-                 
-             //check if it is enought time to make it to the next flight
-             int min_connection = airports[current->airport_index].min_waiting_time;
-             if (!is_connection_possible(current->arrival_time, flights[i].departure_time,
-                                       current->arrival_day, flights[i].day_of_week,
-                                       min_connection))
+         //get the min waiting time specific for the airport, or use the default time
+         cJSON* min_wait = cJSON_GetObjectItem(airport, "min_waiting_time");
+         tt->airports[tt->num_airports].min_waiting_time = min_wait ? min_wait->valueint : tt->connection_time_required;
+         
+         tt->num_airports++;
+     }
+ 
+     //the optional city groups, every member has to be one of the airports
+     //"groups": [{"code": "LON", "airports": ["LHR", "LGW", "STN"]}, ...]
+     cJSON* groups_json = cJSON_GetObjectItem(json, "groups");
+     for (cJSON* group = groups_json ? groups_json->child : NULL; group && tt->num_groups < MAX_GROUPS; group = group->next) {
+         cJSON* code = cJSON_GetObjectItem(group, "code");
+         cJSON* members = cJSON_GetObjectItem(group, "airports");
+         if (!code || !code->valuestring || !members || !validate_airport_code(code->valuestring)) {
+             fprintf(stderr, "Warning: Invalid airport group\n");
+             continue;
+         }
+         AirportGroup* g = &tt->groups[tt->num_groups];
+         strncpy(g->code, code->valuestring, 3);
+         g->code[3] = '\0';
+         g->count = 0;
+         for (cJSON* member = members->child; member && g->count < MAX_GROUP_AIRPORTS; member = member->next) {
+             int index = member->valuestring ? find_airport_index(tt, member->valuestring) : -1;
+             if (index < 0) {
+                 fprintf(stderr, "Warning: Unknown airport in group %s\n", g->code);
                  continue;
-                 
-             //total cost depending on the route type
-             double route_cost = calculate_route_cost(
-                 route_type, 
-                 flights[i].cost, 
-                 flights[i].duration + calculate_wait_time(
-                     current->arrival_time, 
-                     current->arrival_day,
-                     flights[i].departure_time,
-                     flights[i].day_of_week
-                 ),
-                 flights[i].distance
-             );
-             
-             double total_cost = current->g_cost + route_cost;
-             
-             //if this path is better than any previous path to this airport
-             //update the best path information
-             if (total_cost < best_cost[next_index]) {
-                 best_cost[next_index] = total_cost;
-                 best_parent[next_index] = current->airport_index;
-                 best_flight[next_index] = i;
-                 best_arrival_time[next_index] = flights[i].arrival_time;
-                 
-                 //calculate the arrival day
-                 if (flights[i].arrival_time < flights[i].departure_time) {
-                     get_next_day(flights[i].day_of_week, best_arrival_day[next_index]);
-                 } else {
-                    //this means the arrival is on the same day
-                     strcpy(best_arrival_day[next_index], flights[i].day_of_week);
-                 }
-                 
-                 //create and enqueue neighbor node in order to visit
-                 Node* neighbor = (Node*)malloc(sizeof(Node));
-                 neighbor->airport_index = next_index;
-                 neighbor->g_cost = total_cost;
-                 neighbor->h_cost = heuristic(next_index, goal_index, route_type);
-                 neighbor->f_cost = neighbor->g_cost + neighbor->h_cost;
-                 neighbor->parent_index = current->airport_index;
-                 neighbor->flight_index = i;
-                 neighbor->arrival_time = flights[i].arrival_time;
-                 strcpy(neighbor->arrival_day, best_arrival_day[next_index]);
-                 
-                 pq_enqueue(&open_set, neighbor);
              }
+             g->airports[g->count++] = index;
          }
-         //free the curent node after it is been visited
-         free(current);
+         if (g->count > 0) tt->num_groups++;
      }
-     
-     //free all allocated memory
-     while (open_set.size > 0) {
-         free(pq_dequeue(&open_set));
+ 
+     //here parsing the flights section with validation
+     cJSON* flights_json = cJSON_GetObjectItem(json, "flights");
+     if (!flights_json) {
+         fprintf(stderr, "Error: Missing 'flights' in JSON\n");
+         cJSON_Delete(json);
+         free(json_str);
+         timetable_release(tt);
+         return NULL;
+     }
+ 
+     //collecting the flight entries once, cJSON_GetArrayItem would walk
+     //the list from the start for every flight
+     int flight_count = cJSON_GetArraySize(flights_json);
+     cJSON** entries = (cJSON**)malloc((flight_count + 1) * sizeof(cJSON*));
+     if (!entries) {
+         fprintf(stderr, "Error: Memory allocation failed\n");
+         cJSON_Delete(json);
+         free(json_str);
+         timetable_release(tt);
+         return NULL;
+     }
+     int entry = 0;
+     for (cJSON* flight_info = flights_json->child; flight_info; flight_info = flight_info->next) {
+         entries[entry++] = flight_info;
+     }
+ 
+     bool flights_parsed = parse_flights_parallel(tt, entries, flight_count);
+     free(entries);
+     if (!flights_parsed) {
+         cJSON_Delete(json);
+         free(json_str);
+         timetable_release(tt);
+         return NULL;
+     }
+ 
+     //parse the configuration section of the json if it is present
+     cJSON* config = cJSON_GetObjectItem(json, "config");
+     if (config) {
+         cJSON* conn_time = cJSON_GetObjectItem(config, "min_connection_time");
+         if (conn_time) tt->connection_time_required = conn_time->valueint;
      }
      
-     //I want break free
-     //I want to break free from the
-     //DSA Project
-     free(closed_set);
-     free(best_cost);
-     free(best_parent);
-     free(best_flight);
-     free(best_arrival_time);
+     //clean up the json parser and the buffer it was parsed from
+     cJSON_Delete(json);
+     free(json_str);
      
-     for (int i = 0; i < num_airports; i++) {
-         free(best_arrival_day[i]);
+     //check if we found any valid airports and flights
+     if (tt->num_airports == 0 || tt->num_flights == 0 || !build_departure_index(tt)) {
+         fprintf(stderr, "Error: No valid airports or flights found\n");
+         timetable_release(tt);
+         return NULL;
      }
-     free(best_arrival_day);
      
-     //Error if no path was found
-     if (!path_found) {
-         fprintf(stderr, "Error: No viable path found from %s to %s\n", 
-                 start_code, goal_code);
+     return tt;
+ }
+ 
+ //finds a scheduled flight by its route, day and departure time
+ //only the flights of the origin leaving at that time are looked at, returns -1 if there is no such flight
+ int find_scheduled_flight(const Timetable* tt, int from_index, const char* to, const char* day, int departure_time) {
+     const DepartureList* list = &tt->departures[from_index];
+     int minute_of_week = find_day_index(day) * 1440 + departure_time;
+     for (int k = departure_index_lower_bound(list, minute_of_week);
+          k < list->count && list->flights[k].minute_of_week == minute_of_week; k++) {
+         const ScheduledFlight* f = &tt->flights[list->flights[k].flight_index];
+         if (f->departure_time == departure_time && strcmp(f->to, to) == 0 &&
+             strcmp(f->day_of_week, day) == 0)
+             return list->flights[k].flight_index;
      }
-     
-     return path_found;
+     return -1;
  }
 
- //converts the time string to minutes since midnight
-int time_to_minutes(const char* time_str) {
-    int hours, minutes;
-    if (sscanf(time_str, "%d:%d", &hours, &minutes) != 2) {
-        fprintf(stderr, "Invalid time format: %s\n", time_str);
-        return -1;
-    }
-    return hours * 60 + minutes;
-}
-
-//calculates the time difference between 2 times the start and end time
-int time_difference(int time1, int time2) {
-    //same day
-    if (time2 >= time1) return time2 - time1;
-    //overnight
-    return (24 * 60 - time1) + time2;
-}
-
-//calculates the distance between 2 points using the Haversine formula
-double calculate_distance(double lat1, double lon1, double lat2, double lon2) {
-    //converting from degrees to radians
-    double dLat = (lat2 - lat1) * M_PI / 180.0;
-    double dLon = (lon2 - lon1) * M_PI / 180.0;
+ /*adds the seats sold on the flights of one timetable to the same flights,
+ by origin, destination, day and departure, of a timetable with another
+ ledger, a flight the new timetable does not have any more keeps nothing
+ a booking made on the old timetable while this runs would not be carried
+ over, timetable_publish runs it with booking_lock held exclusive
+*/
+ void seat_ledger_carry_over(const Timetable* from, const Timetable* to) {
+     for (int i = 0; i < from->num_flights; i++) {
+         const ScheduledFlight* f = &from->flights[i];
+         int from_index = -1;
+         for (int a = 0; a < to->num_airports && from_index < 0; a++) {
+             if (strcmp(to->airports[a].code, f->from) == 0) from_index = a;
+         }
+         int flight_index = -1;
+         for (int c = 0; c < NUM_CABINS; c++) {
+             atomic_int* sold = seat_counter(from, i, (CabinClass)c, false);
+             int taken = sold ? atomic_load(sold) : 0;
+             if (taken == 0 || from_index < 0) continue;
+             if (flight_index < 0) flight_index = find_scheduled_flight(to, from_index, f->to, f->day_of_week, f->departure_time);
+             atomic_int* moved = flight_index >= 0 ? seat_counter(to, flight_index, (CabinClass)c, true) : NULL;
+             if (moved) atomic_fetch_add(moved, taken);
+         }
+     }
+ }
+ 
+ //loads a timetable, see parse_timetable_file, with the allocations counted
+ //for the loader and reported in the accounting build
+ Timetable* parse_json_input(const char* filename) {
+     AllocSite previous_site = alloc_site_enter(ALLOC_LOADER);
+ #ifdef ALLOC_ACCOUNTING
+     AllocTally before;
+     alloc_tally(&before, false);
+ #endif
+     Timetable* tt = parse_timetable_file(filename);
+ #ifdef ALLOC_ACCOUNTING
+     alloc_report("loading", filename, &before, false);
+ #endif
+     alloc_site_leave(previous_site);
+     return tt;
+ }
+ 
+ /* applies a file of timetable changes on top of a copy of the base timetable
+ the format is {"changes": [ ... ]} where every change names a flight by
+ "from", "to", "day" and "departure_time" and has an "action":
+   "add"    - new flight, also needs "arrival_time", "base_cost", "cost_multiplier"
+              and optionally "distance" and "seats"
+   "cancel" - the flight is no longer available
+   "modify" - any of "new_departure_time", "new_arrival_time", "cost_multiplier", "seats"
+ every change only touches the flight itself, the departure list of its origin
+ and the arrival list of its destination, so past the copy the cost is proportional to the size of the delta, not of the timetable
+ returns the new timetable, not published yet, or NULL on errors, a list that
+ could not grow fails the whole delta rather than leave a flight out of it
+ */
+ Timetable* apply_delta_file(const Timetable* base, const char* filename) {
+     char* json_str = read_file(filename);
+     if (!json_str) return NULL;
+     
+     cJSON* json = cJSON_ParseInSitu(json_str);
+     cJSON* changes = json ? cJSON_GetObjectItem(json, "changes") : NULL;
+     if (!changes) {
+         fprintf(stderr, "Error: Invalid delta file %s\n", filename);
+         cJSON_Delete(json);
+         free(json_str);
+         return NULL;
+     }
+     
+     //the base may be in use by searches, so the changes go to a copy
+     Timetable* tt = timetable_clone(base);
+     if (!tt) {
+         cJSON_Delete(json);
+         free(json_str);
+         return NULL;
+     }
+     
+     int change_count = cJSON_GetArraySize(changes);
+     bool indexed = true;
+     for (int i = 0; i < change_count && indexed; i++) {
+         cJSON* change = cJSON_GetArrayItem(changes, i);
+         cJSON* action = cJSON_GetObjectItem(change, "action");
+         cJSON* from = cJSON_GetObjectItem(change, "from");
+         cJSON* to = cJSON_GetObjectItem(change, "to");
+         cJSON* day = cJSON_GetObjectItem(change, "day");
+         cJSON* departure = cJSON_GetObjectItem(change, "departure_time");
+         
+         //every change has to identify its flight
+         if (!is_json_string(action) || !is_json_string(from) || !is_json_string(to) ||
+             !is_json_string(day) || !is_json_string(departure) ||
+             !validate_airport_code(from->valuestring) || !validate_airport_code(to->valuestring) ||
+             find_day_index(day->valuestring) < 0) {
+             fprintf(stderr, "Warning: Incomplete change at index %d\n", i);
+             continue;
+         }
+         
+         int from_index = find_airport_index(tt, from->valuestring);
+         if (from_index < 0) continue;
+         int departure_time = time_to_minutes(departure->valuestring);
+         int flight_index = find_scheduled_flight(tt, from_index, to->valuestring,
+                                                  day->valuestring, departure_time);
+         
+         if (strcmp(action->valuestring, "add") == 0) {
+             cJSON* arrival = cJSON_GetObjectItem(change, "arrival_time");
+             cJSON* base_cost = cJSON_GetObjectItem(change, "base_cost");
+             cJSON* cost_multiplier = cJSON_GetObjectItem(change, "cost_multiplier");
+             if (!is_json_string(arrival) || !base_cost || (base_cost->type & 0xFF) != cJSON_Number ||
+                 !cost_multiplier || (cost_multiplier->type & 0xFF) != cJSON_Number) {
+                 fprintf(stderr, "Warning: Incomplete flight data in change %d\n", i);
+                 continue;
+             }
+             //adding a flight that already exists, for example one that was cancelled
+             //before, just replaces its schedule, it may land at another time
+             bool is_new = flight_index < 0;
+             if (is_new) {
+                 if (tt->num_flights >= MAX_FLIGHTS || !timetable_reserve_flights(tt, tt->num_flights + 1)) {
+                     fprintf(stderr, "Warning: Too many flights, change %d ignored\n", i);
+                     continue;
+                 }
+                 flight_index = tt->num_flights;
+             } else if (tt->flights[flight_index].to_index >= 0) {
+                 arrival_index_remove(tt, tt->flights[flight_index].to_index, flight_index);
+             }
+             init_scheduled_flight(tt, &tt->flights[flight_index], from->valuestring, to->valuestring,
+                                   days_of_week[find_day_index(day->valuestring)],
+                                   departure_time, time_to_minutes(arrival->valuestring),
+                                   base_cost->valuedouble, cost_multiplier->valuedouble,
+                                   cJSON_GetObjectItem(change, "distance"),
+                                   cJSON_GetObjectItem(change, "seats"));
+             int to_index = tt->flights[flight_index].to_index;
+             if (is_new) {
+                 indexed = departure_index_add(tt, from_index, flight_index) &&
+                           (to_index < 0 || arrival_index_add(tt, to_index, flight_index));
+                 if (indexed) tt->num_flights++;
+             } else if (to_index >= 0) {
+                 indexed = arrival_index_add(tt, to_index, flight_index);
+             }
+         } else if (flight_index < 0) {
+             fprintf(stderr, "Warning: Change %d refers to an unknown flight\n", i);
+         } else if (strcmp(action->valuestring, "cancel") == 0) {
+             tt->flights[flight_index].available = false;
+         } else if (strcmp(action->valuestring, "modify") == 0) {
+             ScheduledFlight* f = &tt->flights[flight_index];
+             cJSON* new_departure = cJSON_GetObjectItem(change, "new_departure_time");
+             cJSON* new_arrival = cJSON_GetObjectItem(change, "new_arrival_time");
+             cJSON* cost_multiplier = cJSON_GetObjectItem(change, "cost_multiplier");
+             cJSON* seats = cJSON_GetObjectItem(change, "seats");
+             if ((new_departure && !is_json_string(new_departure)) || (new_arrival && !is_json_string(new_arrival)) ||
+                 (cost_multiplier && (cost_multiplier->type & 0xFF) != cJSON_Number)) {
+                 fprintf(stderr, "Warning: Malformed change at index %d\n", i);
+                 continue;
+             }
+             
+             //a new departure time moves the flight in the departure list, and
+             //either time in the arrival list
+             if (f->to_index >= 0 && (new_departure || new_arrival))
+                 arrival_index_remove(tt, f->to_index, flight_index);
+             if (new_departure) {
+                 departure_index_remove(tt, from_index, flight_index);
+                 f->departure_time = time_to_minutes(new_departure->valuestring);
+                 indexed = departure_index_add(tt, from_index, flight_index);
+             }
+             if (new_arrival) f->arrival_time = time_to_minutes(new_arrival->valuestring);
+             f->duration = time_difference(f->departure_time, f->arrival_time);
+             if (indexed && f->to_index >= 0 && (new_departure || new_arrival))
+                 indexed = arrival_index_add(tt, f->to_index, flight_index);
+             if (cost_multiplier) f->cost = llround(f->base_cost * cost_multiplier->valuedouble);
+             //seats already sold stay sold, a cabin cut below them is just sold out
+             for (int c = 0; seats && c < NUM_CABINS; c++) {
+                 cJSON* count = cJSON_GetObjectItem(seats, cabin_names[c]);
+                 if (count && !valid_seat_count(count)) {
+                     fprintf(stderr, "Warning: Invalid %s seats in change %d\n", cabin_names[c], i);
+                 } else if (count) {
+                     f->seats[c] = count->valueint;
+                 }
+             }
+         } else {
+             fprintf(stderr, "Warning: Unknown action '%s' in change %d\n", action->valuestring, i);
+         }
+     }
+     if (!indexed) {
+         fprintf(stderr, "Error: Memory allocation failed, delta %s not applied\n", filename);
+         timetable_release(tt);
+         tt = NULL;
+     }
+     
+     cJSON_Delete(json);
+     free(json_str);
+     return tt;
+ }
+ 
+ //applies a delta, see apply_delta_file, with the allocations counted like a load
+ Timetable* apply_timetable_delta(const Timetable* base, const char* filename) {
+     AllocSite previous_site = alloc_site_enter(ALLOC_LOADER);
+ #ifdef ALLOC_ACCOUNTING
+     AllocTally before;
+     alloc_tally(&before, false);
+ #endif
+     Timetable* tt = apply_delta_file(base, filename);
+ #ifdef ALLOC_ACCOUNTING
+     alloc_report("applying", filename, &before, false);
+ #endif
+     alloc_site_leave(previous_site);
+     return tt;
+ }
+ 
+ //writes the book record of a booking to buf, returns its length or -1 if it does not fit
+ int format_booking_record(char* buf, int size, const Booking* booking) {
+     int n = snprintf(buf, size, "book %s %s %d %d", booking->id, cabin_names[booking->cabin],
+                      booking->seats, booking->count);
+     for (int i = 0; i < booking->count && n < size; i++) {
+         const FlightKey* key = &booking->legs[i];
+         char time_str[MAX_TIME_LENGTH];
+         minutes_to_time(key->departure_time, time_str);
+         n += snprintf(buf + n, size - n, " %s %s %s %s", key->from, key->to, key->day, time_str);
+     }
+     if (n + 1 >= size) return -1;
+     buf[n++] = '\n';
+     buf[n] = '\0';
+     return n;
+ }
+ 
+ int find_cabin_index(const char* name) {
+     for (int c = 0; c < NUM_CABINS; c++) {
+         if (strcmp(cabin_names[c], name) == 0) return c;
+     }
+     return -1;
+ }
+ 
+ //the flight a record or the snapshot names, -1 if the timetable does not have it
+ int find_flight_by_key(const Timetable* tt, const char* from, const char* to, const char* day, const char* time_str) {
+     if (!validate_airport_code(from) || !validate_airport_code(to) || find_day_index(day) < 0) return -1;
+     int from_index = find_airport_index(tt, from);
+     if (from_index < 0) return -1;
+     return find_scheduled_flight(tt, from_index, to, day, time_to_minutes(time_str));
+ }
+ 
+ //fills key from the strings of a record or the snapshot, false if they cannot name a flight
+ bool parse_flight_key(FlightKey* key, const char* from, const char* to, const char* day, const char* time_str) {
+     int day_index = find_day_index(day);
+     if (!validate_airport_code(from) || !validate_airport_code(to) || day_index < 0) return false;
+     memcpy(key->from, from, sizeof(key->from));
+     memcpy(key->to, to, sizeof(key->to));
+     snprintf(key->day, sizeof(key->day), "%s", days_of_week[day_index]);
+     key->departure_time = time_to_minutes(time_str);
+     return true;
+ }
+ 
+ //the flight a key names, -1 if the timetable does not have it
+ int find_keyed_flight(const Timetable* tt, const FlightKey* key) {
+     int from_index = find_airport_index(tt, key->from);
+     if (from_index < 0) return -1;
+     return find_scheduled_flight(tt, from_index, key->to, key->day, key->departure_time);
+ }
+ 
+ //a booking id is BOOKING_ID_BYTES random bytes in lowercase hex
+ bool valid_booking_id(const char* id) {
+     int length = 0;
+     for (; id[length]; length++) {
+         if (!isdigit((unsigned char)id[length]) && (id[length] < 'a' || id[length] > 'f')) return false;
+     }
+     return length == BOOKING_ID_LENGTH - 1;
+ }
+ 
+ //fills buf with random bytes from the system, false if there are none to be had
+ bool random_bytes(unsigned char* buf, int size) {
+ #ifdef _WIN32
+     for (int i = 0; i < size; i++) {
+         unsigned int value;
+         if (rand_s(&value) != 0) return false;
+         buf[i] = (unsigned char)value;
+     }
+     return true;
+ #else
+     FILE* file = fopen("/dev/urandom", "rb");
+     if (!file) return false;
+     bool ok = fread(buf, 1, size, file) == (size_t)size;
+     fclose(file);
+     return ok;
+ #endif
+ }
+ 
+ void booking_table_init(BookingTable* table) {
+     pthread_mutex_init(&table->lock, NULL);
+     table->buckets = NULL;
+     table->bucket_count = 0;
+     table->count = 0;
+ }
+ 
+ void booking_table_destroy(BookingTable* table) {
+     for (int i = 0; i < table->bucket_count; i++) {
+         while (table->buckets[i]) {
+             Booking* booking = table->buckets[i];
+             table->buckets[i] = booking->next;
+             free(booking);
+         }
+     }
+     free(table->buckets);
+     pthread_mutex_destroy(&table->lock);
+ }
+ 
+ //FNV-1a of the id
+ unsigned int booking_hash(const char* id) {
+     unsigned int hash = 2166136261u;
+     for (; *id; id++) hash = (hash ^ (unsigned char)*id) * 16777619u;
+     return hash;
+ }
+ 
+ //the booking with the id, NULL if there is none, the caller holds the lock
+ //of the table, or is the only thread that has it, like the replay
+ Booking* booking_find(const BookingTable* table, const char* id) {
+     if (table->bucket_count == 0) return NULL;
+     Booking* booking = table->buckets[booking_hash(id) % table->bucket_count];
+     while (booking && strcmp(booking->id, id) != 0) booking = booking->next;
+     return booking;
+ }
+ 
+ //adds a booking, the table doubles its buckets once it holds as many bookings,
+ //returns false if they could not be allocated, the caller holds the lock
+ bool booking_insert(BookingTable* table, Booking* booking) {
+     if (table->count >= table->bucket_count) {
+         int bucket_count = table->bucket_count ? table->bucket_count * 2 : 1024;
+         Booking** buckets = (Booking**)calloc(bucket_count, sizeof(Booking*));
+         if (!buckets) {
+             fprintf(stderr, "Error: Memory allocation failed\n");
+             return false;
+         }
+         for (int i = 0; i < table->bucket_count; i++) {
+             while (table->buckets[i]) {
+                 Booking* moved = table->buckets[i];
+                 table->buckets[i] = moved->next;
+                 int k = booking_hash(moved->id) % bucket_count;
+                 moved->next = buckets[k];
+                 buckets[k] = moved;
+             }
+         }
+         free(table->buckets);
+         table->buckets = buckets;
+         table->bucket_count = bucket_count;
+     }
+     int k = booking_hash(booking->id) % table->bucket_count;
+     booking->next = table->buckets[k];
+     table->buckets[k] = booking;
+     table->count++;
+     return true;
+ }
+ 
+ //takes a booking out of the table and frees it, the caller holds the lock
+ void booking_remove(BookingTable* table, Booking* booking) {
+     Booking** link = &table->buckets[booking_hash(booking->id) % table->bucket_count];
+     while (*link != booking) link = &(*link)->next;
+     *link = booking->next;
+     table->count--;
+     free(booking);
+ }
+ 
+ //a booking with room for count legs, which the caller fills in
+ Booking* booking_create(const char* id, CabinClass cabin, int seats, int count) {
+     Booking* booking = (Booking*)calloc(1, sizeof(Booking) + count * sizeof(FlightKey));
+     if (!booking) {
+         fprintf(stderr, "Error: Memory allocation failed\n");
+         return NULL;
+     }
+     snprintf(booking->id, sizeof(booking->id), "%s", id);
+     booking->cabin = cabin;
+     booking->seats = seats;
+     booking->count = count;
+     return booking;
+ }
+ 
+ //a booking of flights of tt under a new id, NULL if it could not be made
+ Booking* new_booking(const Timetable* tt, const int* flights, int count, CabinClass cabin, int seats) {
+     unsigned char bytes[BOOKING_ID_BYTES];
+     char id[BOOKING_ID_LENGTH];
+     if (!random_bytes(bytes, BOOKING_ID_BYTES)) {
+         fprintf(stderr, "Error: Could not get random bytes for a booking id\n");
+         return NULL;
+     }
+     for (int i = 0; i < BOOKING_ID_BYTES; i++) {
+         snprintf(id + 2 * i, 3, "%02x", bytes[i]);
+     }
+     Booking* booking = booking_create(id, cabin, seats, count);
+     for (int i = 0; booking && i < count; i++) {
+         const ScheduledFlight* f = &tt->flights[flights[i]];
+         FlightKey* key = &booking->legs[i];
+         memcpy(key->from, f->from, sizeof(key->from));
+         memcpy(key->to, f->to, sizeof(key->to));
+         snprintf(key->day, sizeof(key->day), "%s", f->day_of_week);
+         key->departure_time = f->departure_time;
+     }
+     return booking;
+ }
+ 
+ //adds delta seats to a sold counter without checking the cabin size,
+ //what was sold before a restart stays sold
+ void adjust_seats_sold(const Timetable* tt, int flight_index, int cabin, int delta) {
+     atomic_int* sold = seat_counter(tt, flight_index, (CabinClass)cabin, true);
+     if (sold) atomic_fetch_add(sold, delta);
+ }
+ 
+ //gives back seats of a booking while the journal is replayed
+ void replay_booking_release(const Timetable* tt, BookingTable* bookings, Booking* booking, int seats) {
+     for (int i = 0; i < booking->count; i++) {
+         int flight_index = find_keyed_flight(tt, &booking->legs[i]);
+         if (flight_index >= 0) adjust_seats_sold(tt, flight_index, booking->cabin, -seats);
+     }
+     booking->seats -= seats;
+     if (booking->seats == 0) booking_remove(bookings, booking);
+ }
+ 
+ //applies one log line, returns false if it is malformed, names an unknown
+ //flight or releases more than its booking holds
+ bool replay_booking_record(const Timetable* tt, BookingTable* bookings, char* line) {
+     char* action = strtok(line, " \n");
+     char* id = strtok(NULL, " \n");
+     if (!action || !id) return false;
+     //the records from before the ids start with the cabin
+     bool has_id = find_cabin_index(id) < 0;
+     if (has_id && !valid_booking_id(id)) return false;
+     if (has_id && strcmp(action, "release") == 0) {
+         char* seats_str = strtok(NULL, " \n");
+         int seats = seats_str ? atoi(seats_str) : 0;
+         Booking* booking = booking_find(bookings, id);
+         if (!booking || seats <= 0 || seats > booking->seats) return false;
+         replay_booking_release(tt, bookings, booking, seats);
+         return true;
+     }
+     char* cabin_name = has_id ? strtok(NULL, " \n") : id;
+     char* seats_str = strtok(NULL, " \n");
+     char* count_str = strtok(NULL, " \n");
+     if (!cabin_name || !seats_str || !count_str) return false;
+     int cabin = find_cabin_index(cabin_name);
+     int seats = atoi(seats_str);
+     int count = atoi(count_str);
+     int sign = strcmp(action, "book") == 0 ? 1 : strcmp(action, "release") == 0 ? -1 : 0;
+     if (cabin < 0 || sign == 0 || seats <= 0 || count <= 0 || count > MAX_PATH) return false;
+     if (has_id && booking_find(bookings, id)) return false;
+     
+     Booking* booking = has_id ? booking_create(id, (CabinClass)cabin, seats, count) : NULL;
+     if (has_id && !booking) return false;
+     int flights[MAX_PATH];
+     for (int i = 0; i < count; i++) {
+         char* from = strtok(NULL, " \n");
+         char* to = strtok(NULL, " \n");
+         char* day = strtok(NULL, " \n");
+         char* time_str = strtok(NULL, " \n");
+         FlightKey key;
+         flights[i] = (from && to && day && time_str && parse_flight_key(&key, from, to, day, time_str))
+             ? find_keyed_flight(tt, &key) : -1;
+         if (flights[i] < 0) {
+             free(booking);
+             return false;
+         }
+         if (booking) booking->legs[i] = key;
+     }
+     if (booking && !booking_insert(bookings, booking)) {
+         free(booking);
+         return false;
+     }
+     for (int i = 0; i < count; i++) {
+         adjust_seats_sold(tt, flights[i], cabin, sign * seats);
+     }
+     return true;
+ }
+ 
+ //one entry of the bookings of a snapshot, NULL if it is not valid
+ Booking* parse_snapshot_booking(cJSON* entry) {
+     cJSON* id = cJSON_GetObjectItem(entry, "id");
+     cJSON* cabin_item = cJSON_GetObjectItem(entry, "cabin");
+     cJSON* seats = cJSON_GetObjectItem(entry, "seats");
+     cJSON* segments = cJSON_GetObjectItem(entry, "segments");
+     int cabin = is_json_string(cabin_item) ? find_cabin_index(cabin_item->valuestring) : -1;
+     int count = segments ? cJSON_GetArraySize(segments) : 0;
+     if (!is_json_string(id) || !valid_booking_id(id->valuestring) || cabin < 0 ||
+         !seats || (seats->type & 0xFF) != cJSON_Number || seats->valueint <= 0 ||
+         count <= 0 || count > MAX_PATH) return NULL;
+     Booking* booking = booking_create(id->valuestring, (CabinClass)cabin, seats->valueint, count);
+     for (int i = 0; booking && i < count; i++) {
+         cJSON* segment = cJSON_GetArrayItem(segments, i);
+         cJSON* from = cJSON_GetObjectItem(segment, "from");
+         cJSON* to = cJSON_GetObjectItem(segment, "to");
+         cJSON* day = cJSON_GetObjectItem(segment, "day");
+         cJSON* departure = cJSON_GetObjectItem(segment, "departure_time");
+         if (!is_json_string(from) || !is_json_string(to) || !is_json_string(day) || !is_json_string(departure) ||
+             !parse_flight_key(&booking->legs[i], from->valuestring, to->valuestring,
+                               day->valuestring, departure->valuestring)) {
+             free(booking);
+             booking = NULL;
+         }
+     }
+     return booking;
+ }
+ 
+ //loads the seats sold and the bookings from a snapshot file, returns its
+ //generation, 0 if there is no snapshot yet and -1 on errors
+ int load_booking_snapshot(const Timetable* tt, BookingTable* bookings, const char* filename) {
+     FILE* file = fopen(filename, "r");
+     if (!file) return 0;
+     fclose(file);
+     
+     char* json_str = read_file(filename);
+     if (!json_str) return -1;
+     cJSON* json = cJSON_ParseInSitu(json_str);
+     cJSON* generation = json ? cJSON_GetObjectItem(json, "generation") : NULL;
+     cJSON* seats_sold = json ? cJSON_GetObjectItem(json, "seats_sold") : NULL;
+     if (!generation || !seats_sold) {
+         fprintf(stderr, "Error: Invalid booking snapshot %s\n", filename);
+         cJSON_Delete(json);
+         free(json_str);
+         return -1;
+     }
+     
+     int count = cJSON_GetArraySize(seats_sold);
+     for (int i = 0; i < count; i++) {
+         cJSON* entry = cJSON_GetArrayItem(seats_sold, i);
+         cJSON* from = cJSON_GetObjectItem(entry, "from");
+         cJSON* to = cJSON_GetObjectItem(entry, "to");
+         cJSON* day = cJSON_GetObjectItem(entry, "day");
+         cJSON* departure = cJSON_GetObjectItem(entry, "departure_time");
+         int flight_index = (is_json_string(from) && is_json_string(to) && is_json_string(day) && is_json_string(departure)) ?
+             find_flight_by_key(tt, from->valuestring, to->valuestring, day->valuestring, departure->valuestring) : -1;
+         if (flight_index < 0) {
+             fprintf(stderr, "Warning: Booking snapshot entry %d names an unknown flight\n", i);
+             continue;
+         }
+         for (int c = 0; c < NUM_CABINS; c++) {
+             cJSON* sold = cJSON_GetObjectItem(entry, cabin_names[c]);
+             if (sold) adjust_seats_sold(tt, flight_index, c, sold->valueint);
+         }
+     }
+     
+     //the seats of the bookings are already counted above
+     cJSON* held = cJSON_GetObjectItem(json, "bookings");
+     int held_count = held ? cJSON_GetArraySize(held) : 0;
+     for (int i = 0; i < held_count; i++) {
+         Booking* booking = parse_snapshot_booking(cJSON_GetArrayItem(held, i));
+         if (!booking || booking_find(bookings, booking->id) || !booking_insert(bookings, booking)) {
+             fprintf(stderr, "Warning: Skipping booking %d of the booking snapshot\n", i);
+             free(booking);
+         }
+     }
+     
+     int result = generation->valueint;
+     cJSON_Delete(json);
+     free(json_str);
+     return result;
+ }
+ 
+ //replays a log that builds on the given snapshot generation, a missing log is empty
+ bool replay_booking_log(const Timetable* tt, BookingTable* bookings, const char* filename, int generation) {
+     FILE* file = fopen(filename, "r");
+     if (!file) return true;
+     
+     char line[4096];
+     int log_generation = -1;
+     if (!fgets(line, sizeof(line), file) || sscanf(line, "journal %d", &log_generation) != 1) {
+         //a log cut before its header was ever written has no records either
+         fclose(file);
+         return true;
+     }
+     if (log_generation != generation) {
+         fclose(file);
+         return true;
+     }
+     int line_number = 1;
+     while (fgets(line, sizeof(line), file)) {
+         line_number++;
+         if (!strchr(line, '\n')) {
+             fprintf(stderr, "Warning: Ignoring the incomplete last record of %s\n", filename);
+             break;
+         }
+         if (!replay_booking_record(tt, bookings, line)) {
+             fprintf(stderr, "Warning: Skipping booking record on line %d of %s\n", line_number, filename);
+         }
+     }
+     fclose(file);
+     return true;
+ }
+ 
+ //flushes a stdio file all the way to the disk
+ bool sync_file(FILE* file) {
+     if (fflush(file) != 0) return false;
+ #ifdef _WIN32
+     return _commit(_fileno(file)) == 0;
+ #else
+     return fsync(fileno(file)) == 0;
+ #endif
+ }
+ 
+ //writes the seats sold and the bookings now as the snapshot of the given
+ //generation, through a temporary file so a crash never leaves half a snapshot
+ bool write_booking_snapshot(const Timetable* tt, const BookingTable* bookings, const char* filename,
+                             int generation) {
+     cJSON* root = cJSON_CreateObject();
+     cJSON_AddNumberToObject(root, "generation", generation);
+     cJSON* seats_sold = cJSON_CreateArray();
+     for (int i = 0; i < tt->num_flights; i++) {
+         int sold[NUM_CABINS];
+         bool any = false;
+         for (int c = 0; c < NUM_CABINS; c++) {
+             atomic_int* counter = seat_counter(tt, i, (CabinClass)c, false);
+             sold[c] = counter ? atomic_load(counter) : 0;
+             if (sold[c] != 0) any = true;
+         }
+         if (!any) continue;
+         
+         const ScheduledFlight* f = &tt->flights[i];
+         char time_str[MAX_TIME_LENGTH];
+         minutes_to_time(f->departure_time, time_str);
+         cJSON* entry = cJSON_CreateObject();
+         cJSON_AddStringToObject(entry, "from", f->from);
+         cJSON_AddStringToObject(entry, "to", f->to);
+         cJSON_AddStringToObject(entry, "day", f->day_of_week);
+         cJSON_AddStringToObject(entry, "departure_time", time_str);
+         for (int c = 0; c < NUM_CABINS; c++) {
+             cJSON_AddNumberToObject(entry, cabin_names[c], sold[c]);
+         }
+         cJSON_AddItemToArray(seats_sold, entry);
+     }
+     cJSON_AddItemToObject(root, "seats_sold", seats_sold);
+     cJSON* held = cJSON_CreateArray();
+     for (int i = 0; i < bookings->bucket_count; i++) {
+         for (const Booking* booking = bookings->buckets[i]; booking; booking = booking->next) {
+             cJSON* entry = cJSON_CreateObject();
+             cJSON_AddStringToObject(entry, "id", booking->id);
+             cJSON_AddStringToObject(entry, "cabin", cabin_names[booking->cabin]);
+             cJSON_AddNumberToObject(entry, "seats", booking->seats);
+             cJSON* segments = cJSON_CreateArray();
+             for (int k = 0; k < booking->count; k++) {
+                 const FlightKey* key = &booking->legs[k];
+                 char time_str[MAX_TIME_LENGTH];
+                 minutes_to_time(key->departure_time, time_str);
+                 cJSON* segment = cJSON_CreateObject();
+                 cJSON_AddStringToObject(segment, "from", key->from);
+                 cJSON_AddStringToObject(segment, "to", key->to);
+                 cJSON_AddStringToObject(segment, "day", key->day);
+                 cJSON_AddStringToObject(segment, "departure_time", time_str);
+                 cJSON_AddItemToArray(segments, segment);
+             }
+             cJSON_AddItemToObject(entry, "segments", segments);
+             cJSON_AddItemToArray(held, entry);
+         }
+     }
+     cJSON_AddItemToObject(root, "bookings", held);
+     char* json_str = cJSON_Print(root);
+     cJSON_Delete(root);
+     if (!json_str) return false;
+     
+     char tmp_name[1024];
+     snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", filename);
+     FILE* file = fopen(tmp_name, "w");
+     bool ok = file && fputs(json_str, file) >= 0;
+     if (file) ok = sync_file(file) && ok;
+     if (file) ok = fclose(file) == 0 && ok;
+     free(json_str);
+ #ifdef _WIN32
+     //rename does not replace an existing file here
+     if (ok) remove(filename);
+ #endif
+     if (ok) ok = rename(tmp_name, filename) == 0;
+     if (!ok) fprintf(stderr, "Error: Could not write booking snapshot %s\n", filename);
+     return ok;
+ }
+ 
+ //flusher thread, writes out the buffered records a group at a time
+ void* journal_flusher(void* arg) {
+     block_server_signals();
+     BookingJournal* journal = (BookingJournal*)arg;
+     char* spare = NULL;
+     int spare_capacity = 0;
+     
+     pthread_mutex_lock(&journal->lock);
+     while (true) {
+         while (journal->pending == 0 && !journal->stopping) {
+             pthread_cond_wait(&journal->has_records, &journal->lock);
+         }
+         if (journal->pending == 0) break;
+         
+         //give the group a moment to fill up
+         struct timespec deadline;
+         clock_gettime(CLOCK_REALTIME, &deadline);
+         deadline.tv_nsec += GROUP_COMMIT_WAIT_US * 1000L;
+         if (deadline.tv_nsec >= 1000000000L) {
+             deadline.tv_sec++;
+             deadline.tv_nsec -= 1000000000L;
+         }
+         while (journal->pending < journal->batch_size && !journal->stopping) {
+             if (pthread_cond_timedwait(&journal->has_records, &journal->lock, &deadline) != 0) break;
+         }
+         
+         //take the group and let the bookers fill the other buffer meanwhile
+         char* records = journal->buffer;
+         int records_capacity = journal->capacity;
+         int length = journal->length;
+         long long last = journal->appended;
+         journal->buffer = spare;
+         journal->capacity = spare_capacity;
+         journal->length = 0;
+         journal->pending = 0;
+         spare = records;
+         spare_capacity = records_capacity;
+         pthread_mutex_unlock(&journal->lock);
+         
+         bool ok = fwrite(records, 1, length, journal->log) == (size_t)length && sync_file(journal->log);
+         
+         pthread_mutex_lock(&journal->lock);
+         journal->flushes++;
+         if (ok) journal->durable = last;
+         else journal->failed = true;
+         pthread_cond_broadcast(&journal->committed);
+     }
+     pthread_mutex_unlock(&journal->lock);
+     free(spare);
+     return NULL;
+ }
+ 
+ /* recovers the seats sold from the snapshot and the log, compacts them and
+ opens a fresh log for the bookings to come, the timetable must be the one
+ the bookings were made on (or a delta of it)
+ returns NULL on errors
+*/
+ BookingJournal* booking_journal_open(const Timetable* tt, const char* snapshot_file,
+                                      const char* log_file, int batch_size) {
+     BookingJournal* journal = (BookingJournal*)calloc(1, sizeof(BookingJournal));
+     if (!journal) return NULL;
+     booking_table_init(&journal->bookings);
+     int generation = load_booking_snapshot(tt, &journal->bookings, snapshot_file);
+     
+     //the new snapshot holds the log, so the log can start over
+     FILE* log = NULL;
+     bool recovered = generation >= 0 && replay_booking_log(tt, &journal->bookings, log_file, generation) &&
+                      write_booking_snapshot(tt, &journal->bookings, snapshot_file, generation + 1);
+     if (recovered) {
+         log = fopen(log_file, "w");
+         if (!log || fprintf(log, "journal %d\n", generation + 1) < 0 || !sync_file(log)) {
+             fprintf(stderr, "Error: Could not open booking log %s\n", log_file);
+             if (log) fclose(log);
+             recovered = false;
+         }
+     }
+     if (!recovered) {
+         booking_table_destroy(&journal->bookings);
+         free(journal);
+         return NULL;
+     }
+     generation++;
+     journal->log = log;
+     journal->generation = generation;
+     journal->batch_size = batch_size > 0 ? batch_size : 1;
+     pthread_mutex_init(&journal->lock, NULL);
+     pthread_cond_init(&journal->has_records, NULL);
+     pthread_cond_init(&journal->committed, NULL);
+     if (pthread_create(&journal->flusher, NULL, journal_flusher, journal) != 0) {
+         fprintf(stderr, "Error: Could not start the journal flusher\n");
+         pthread_cond_destroy(&journal->committed);
+         pthread_cond_destroy(&journal->has_records);
+         pthread_mutex_destroy(&journal->lock);
+         booking_table_destroy(&journal->bookings);
+         fclose(log);
+         free(journal);
+         return NULL;
+     }
+     return journal;
+ }
+ 
+ //writes out what is still buffered and closes the log
+ void booking_journal_close(BookingJournal* journal) {
+     if (!journal) return;
+     pthread_mutex_lock(&journal->lock);
+     journal->stopping = true;
+     pthread_cond_signal(&journal->has_records);
+     pthread_mutex_unlock(&journal->lock);
+     pthread_join(journal->flusher, NULL);
+     
+     fclose(journal->log);
+     pthread_cond_destroy(&journal->committed);
+     pthread_cond_destroy(&journal->has_records);
+     pthread_mutex_destroy(&journal->lock);
+     booking_table_destroy(&journal->bookings);
+     free(journal->buffer);
+     free(journal);
+ }
+ 
+ //appends one record and waits until its group is on disk
+ bool journal_commit(BookingJournal* journal, const char* record, int length) {
+     pthread_mutex_lock(&journal->lock);
+     if (journal->failed || journal->stopping) {
+         pthread_mutex_unlock(&journal->lock);
+         return false;
+     }
+     if (journal->length + length > journal->capacity) {
+         int capacity = journal->capacity ? journal->capacity : 4096;
+         while (capacity < journal->length + length) capacity *= 2;
+         char* grown = (char*)realloc(journal->buffer, capacity);
+         if (!grown) {
+             pthread_mutex_unlock(&journal->lock);
+             fprintf(stderr, "Error: Memory allocation failed\n");
+             return false;
+         }
+         journal->buffer = grown;
+         journal->capacity = capacity;
+     }
+     memcpy(journal->buffer + journal->length, record, length);
+     journal->length += length;
+     long long sequence = ++journal->appended;
+     //the first record starts the group timer, a full group is written at once
+     if (++journal->pending == 1 || journal->pending >= journal->batch_size)
+         pthread_cond_signal(&journal->has_records);
+     
+     while (journal->durable < sequence && !journal->failed) {
+         pthread_cond_wait(&journal->committed, &journal->lock);
+     }
+     bool ok = journal->durable >= sequence;
+     pthread_mutex_unlock(&journal->lock);
+     return ok;
+ }
+ 
+ //reserve_seats, made durable: the seats are taken in memory first and given
+ //back if the record could not be written, BOOKING_DONE once it is on disk,
+ //with the id the booking can be cancelled by in booking_id
+ BookingResult book_seats(BookingJournal* journal, const Timetable* tt, const int* flights, int count,
+                          CabinClass cabin, int seats, char* booking_id) {
+     char record[4096];
+     if (count <= 0 || count > MAX_PATH || !reserve_seats(tt, flights, count, cabin, seats)) return BOOKING_REFUSED;
+     //no one can know the id before it is returned, so the booking is in the
+     //table before its record is on disk
+     BookingTable* bookings = &journal->bookings;
+     Booking* booking = new_booking(tt, flights, count, cabin, seats);
+     int length = booking ? format_booking_record(record, sizeof(record), booking) : -1;
+     pthread_mutex_lock(&bookings->lock);
+     bool inserted = length >= 0 && booking_insert(bookings, booking);
+     pthread_mutex_unlock(&bookings->lock);
+     if (!inserted) {
+         free(booking);
+         release_seats(tt, flights, count, cabin, seats);
+         return BOOKING_FAILED;
+     }
+     snprintf(booking_id, BOOKING_ID_LENGTH, "%s", booking->id);
+     if (!journal_commit(journal, record, length)) {
+         pthread_mutex_lock(&bookings->lock);
+         booking_remove(bookings, booking);
+         pthread_mutex_unlock(&bookings->lock);
+         release_seats(tt, flights, count, cabin, seats);
+         return BOOKING_FAILED;
+     }
+     return BOOKING_DONE;
+ }
+ 
+ /*gives back seats of a booking, all it still holds if seats is 0, made
+ durable: the seats are taken off the booking and freed in memory first, so
+ nothing is written for more seats than it holds, and both are undone if the
+ record could not be written (a booking made in that short while can oversell
+ them, as the failed release leaves them held after a restart too)
+ a leg the timetable no longer has took its seats with it
+*/
+ BookingResult cancel_seats(BookingJournal* journal, const Timetable* tt, const char* booking_id, int seats) {
+     BookingTable* bookings = &journal->bookings;
+     int flights[MAX_PATH];
+     int count = 0;
+     pthread_mutex_lock(&bookings->lock);
+     Booking* booking = booking_find(bookings, booking_id);
+     if (!booking) {
+         pthread_mutex_unlock(&bookings->lock);
+         return BOOKING_UNKNOWN;
+     }
+     if (seats == 0) seats = booking->seats;
+     if (seats <= 0 || seats > booking->seats) {
+         pthread_mutex_unlock(&bookings->lock);
+         return BOOKING_REFUSED;
+     }
+     for (int i = 0; i < booking->count; i++) {
+         int flight_index = find_keyed_flight(tt, &booking->legs[i]);
+         if (flight_index >= 0) flights[count++] = flight_index;
+     }
+     CabinClass cabin = booking->cabin;
+     booking->seats -= seats;
+     booking->releasing++;
+     pthread_mutex_unlock(&bookings->lock);
+     
+     char record[128];
+     int length = snprintf(record, sizeof(record), "release %s %d\n", booking_id, seats);
+     bool released = release_seats(tt, flights, count, cabin, seats);
+     bool committed = released && journal_commit(journal, record, length);
+     if (released && !committed) {
+         for (int i = 0; i < count; i++) {
+             adjust_seats_sold(tt, flights[i], cabin, seats);
+         }
+     }
+     
+     //the last cancellation to finish takes an empty booking out
+     pthread_mutex_lock(&bookings->lock);
+     if (!committed) booking->seats += seats;
+     booking->releasing--;
+     if (booking->seats == 0 && booking->releasing == 0) booking_remove(bookings, booking);
+     pthread_mutex_unlock(&bookings->lock);
+     if (!committed) return released ? BOOKING_FAILED : BOOKING_REFUSED;
+     return BOOKING_DONE;
+ }
+ 
+ //the fares of tt, NULL if they were priced from another snapshot or there are none
+ const Cost* snapshot_fares(const Timetable* tt, const FareTable* fares, CabinClass cabin) {
+     return fares && fares->timetable_version == tt->version && fares->count >= tt->num_flights
+         ? fares->cost[cabin] : NULL;
+ }
+ 
+ //the fare of a flight in a cabin, the static cost times the cabin multiplier
+ //until a pass has priced the snapshot
+ Cost cabin_fare(const Timetable* tt, const FareTable* fares, int flight_index, CabinClass cabin) {
+     const Cost* fare = snapshot_fares(tt, fares, cabin);
+     return fare ? fare[flight_index] : llround(tt->flights[flight_index].cost * cabin_fare_multipliers[cabin]);
+ }
+ 
+ //the fare a search or the output uses for a flight, journeys are priced in economy
+ Cost flight_fare(const Timetable* tt, const FareTable* fares, int flight_index) {
+     const Cost* fare = snapshot_fares(tt, fares, ECONOMY);
+     return fare ? fare[flight_index] : tt->flights[flight_index].cost;
+ }
+ 
+ FareTable* fare_table_acquire(void) {
+     int side = reader_gate_enter(&fare_readers);
+     FareTable* fares = atomic_load(&current_fares);
+     if (fares) atomic_fetch_add(&fares->refcount, 1);
+     reader_gate_leave(&fare_readers, side);
+     return fares;
+ }
+ 
+ void fare_table_release(FareTable* fares) {
+     if (!fares || atomic_fetch_sub(&fares->refcount, 1) != 1) return;
+     for (int c = 0; c < NUM_CABINS; c++) free(fares->cost[c]);
+     free(fares);
+ }
+ 
+ //same protocol as timetable_publish, only the pricing thread publishes
+ void fare_table_publish(FareTable* fares) {
+     FareTable* old = atomic_exchange(&current_fares, fares);
+     reader_gate_wait(&fare_readers);
+     fare_table_release(old);
+ }
+ 
+ bool fare_engine_reserve(FareEngine* engine, int count) {
+     if (count <= engine->capacity) return true;
+     double** columns[3 + 3 * NUM_CABINS] = {&engine->static_cost, &engine->minute_of_week, &engine->days};
+     for (int c = 0; c < NUM_CABINS; c++) {
+         columns[3 + 3 * c] = &engine->seats[c];
+         columns[4 + 3 * c] = &engine->load[c];
+         columns[5 + 3 * c] = &engine->fare[c];
+     }
+     for (int c = 0; c < (int)(sizeof(columns) / sizeof(columns[0])); c++) {
+         double* grown = (double*)realloc(*columns[c], count * sizeof(double));
+         if (!grown) {
+             fprintf(stderr, "Error: Memory allocation failed\n");
+             return false;
+         }
+         *columns[c] = grown;
+     }
+     engine->capacity = count;
+     return true;
+ }
+ 
+ void fare_engine_destroy(FareEngine* engine) {
+     timetable_release(engine->tt);
+     free(engine->static_cost);
+     free(engine->minute_of_week);
+     free(engine->days);
+     for (int c = 0; c < NUM_CABINS; c++) {
+         free(engine->seats[c]);
+         free(engine->load[c]);
+         free(engine->fare[c]);
+     }
+     memset(engine, 0, sizeof(*engine));
+ }
+ 
+ //takes the columns that only change with the timetable from its flights
+ bool gather_static_fare_columns(FareEngine* engine, Timetable* tt) {
+     if (!fare_engine_reserve(engine, tt->num_flights)) return false;
+     for (int i = 0; i < tt->num_flights; i++) {
+         const ScheduledFlight* f = &tt->flights[i];
+         engine->static_cost[i] = (double)f->cost;
+         engine->minute_of_week[i] = find_day_index(f->day_of_week) * 1440.0 + f->departure_time;
+         //a cabin without seats never sells any, its load stays 0
+         for (int c = 0; c < NUM_CABINS; c++) engine->seats[c][i] = f->seats[c] > 0 ? f->seats[c] : 1;
+     }
+     timetable_release(engine->tt);
+     engine->tt = tt;
+     engine->count = tt->num_flights;
+     return true;
+ }
+ 
+ //the column loops below are written to be vectorized, gcc only does that
+ //at -O2 if it may also add the checks and tail loops the counts need
+ #if defined(__GNUC__) && !defined(__clang__)
+ #pragma GCC push_options
+ #pragma GCC optimize("tree-vectorize", "vect-cost-model=dynamic")
+ #endif
+ 
+ //the seats sold come from the counters, a block at a time
+ void gather_load_factors(FareEngine* engine) {
+     for (int first = 0; first < engine->count; first += SEAT_BLOCK_SIZE) {
+         SeatBlock* block = atomic_load(&engine->tt->seats_sold->blocks[first / SEAT_BLOCK_SIZE]);
+         int last = first + SEAT_BLOCK_SIZE < engine->count ? first + SEAT_BLOCK_SIZE : engine->count;
+         for (int i = first; i < last; i++) {
+             for (int c = 0; c < NUM_CABINS; c++) {
+                 engine->load[c][i] = block ? atomic_load_explicit(&block->sold[i - first][c], memory_order_relaxed) : 0;
+             }
+         }
+     }
+     for (int c = 0; c < NUM_CABINS; c++) {
+         for (int i = 0; i < engine->count; i++) {
+             engine->load[c][i] /= engine->seats[c][i];
+         }
+     }
+ }
+ 
+ //the timetable repeats every week, so the next departure is at most a week away
+ void compute_days_to_departure(int count, const double* restrict minute_of_week,
+                                double now, double* restrict days) {
+     for (int i = 0; i < count; i++) {
+         double until = minute_of_week[i] - now;
+         until += until < 0 ? (double)MINUTES_PER_WEEK : 0.0;
+         days[i] = until * (1.0 / 1440.0);
+     }
+ }
+ 
+ /* the pricing kernel, straight line code over the columns with the rules
+ folded into selects, so the compiler turns it into vector code
+ it prices one cabin, the load is the share of that cabin sold
+*/
+ void price_fares(int count, double cabin_multiplier, const double* restrict static_cost,
+                  const double* restrict load, const double* restrict days, double* restrict fares) {
+     for (int i = 0; i < count; i++) {
+         double multiplier = BASE_FARE_MULTIPLIER;
+         //the step loops are unrolled so the loop over the flights is the vector one
+ #if defined(__GNUC__) && !defined(__clang__)
+ #pragma GCC unroll 8
+ #endif
+         for (int s = 0; s < NUM_LOAD_FARE_STEPS; s++) {
+             multiplier += load[i] >= load_fare_steps[s].threshold ? load_fare_steps[s].step : 0.0;
+         }
+ #if defined(__GNUC__) && !defined(__clang__)
+ #pragma GCC unroll 8
+ #endif
+         for (int s = 0; s < NUM_DAYS_FARE_STEPS; s++) {
+             multiplier += days[i] < days_fare_steps[s].threshold ? days_fare_steps[s].step : 0.0;
+         }
+         fares[i] = static_cost[i] * cabin_multiplier * multiplier;
+     }
+ }
+ 
+ #if defined(__GNUC__) && !defined(__clang__)
+ #pragma GCC pop_options
+ #endif
+ 
+ //the minute of the week now, in local time like the timetable
+ double current_minute_of_week(time_t now) {
+     struct tm local;
+ #ifdef _WIN32
+     localtime_s(&local, &now);
+ #else
+     localtime_r(&now, &local);
+ #endif
+     //tm_wday counts from sunday, the timetable from monday
+     return ((local.tm_wday + 6) % 7) * 1440.0 + local.tm_hour * 60 + local.tm_min;
+ }
+ 
+ //prices every flight of the published timetable as of now, returns NULL on errors
+ FareTable* run_pricing_pass(FareEngine* engine, time_t now) {
+     Timetable* tt = timetable_acquire();
+     if (!tt) return NULL;
+     if (tt == engine->tt) {
+         timetable_release(tt);
+     } else if (!gather_static_fare_columns(engine, tt)) {
+         timetable_release(tt);
+         return NULL;
+     }
+     
+     FareTable* fares = (FareTable*)calloc(1, sizeof(FareTable));
+     for (int c = 0; fares && c < NUM_CABINS; c++) {
+         fares->cost[c] = (Cost*)malloc((engine->count > 0 ? engine->count : 1) * sizeof(Cost));
+         if (!fares->cost[c]) {
+             atomic_init(&fares->refcount, 1);
+             fare_table_release(fares);
+             fares = NULL;
+         }
+     }
+     if (!fares) {
+         fprintf(stderr, "Error: Memory allocation failed\n");
+         return NULL;
+     }
+     gather_load_factors(engine);
+     compute_days_to_departure(engine->count, engine->minute_of_week, current_minute_of_week(now), engine->days);
+     for (int c = 0; c < NUM_CABINS; c++) {
+         price_fares(engine->count, cabin_fare_multipliers[c], engine->static_cost, engine->load[c],
+                     engine->days, engine->fare[c]);
+         //rounded apart from the pricing kernel, a packed conversion to 64 bit
+         //integers needs avx-512, without it the kernel would not be vectorized
+         for (int i = 0; i < engine->count; i++) {
+             fares->cost[c][i] = llround(engine->fare[c][i]);
+         }
+     }
+     fares->count = engine->count;
+     fares->timetable_version = engine->tt->version;
+     atomic_init(&fares->refcount, 1);
+     return fares;
+ }
+ 
+ //pricing thread, publishes new fares every interval until it is stopped
+ void* pricing_worker(void* arg) {
+     block_server_signals();
+     PricingThread* pricing = (PricingThread*)arg;
+     FareEngine engine;
+     memset(&engine, 0, sizeof(engine));
+     
+     pthread_mutex_lock(&pricing->lock);
+     while (!pricing->stopping) {
+         pthread_mutex_unlock(&pricing->lock);
+         FareTable* fares = run_pricing_pass(&engine, time(NULL));
+         if (fares) fare_table_publish(fares);
+         pthread_mutex_lock(&pricing->lock);
+         
+         struct timespec deadline;
+         clock_gettime(CLOCK_REALTIME, &deadline);
+         deadline.tv_sec += pricing->interval_seconds;
+         while (!pricing->stopping &&
+                pthread_cond_timedwait(&pricing->wake, &pricing->lock, &deadline) == 0) {
+         }
+     }
+     pthread_mutex_unlock(&pricing->lock);
+     
+     fare_engine_destroy(&engine);
+     return NULL;
+ }
+ 
+ //starts repricing the published timetable every interval, NULL on errors
+ PricingThread* pricing_start(int interval_seconds) {
+     PricingThread* pricing = (PricingThread*)calloc(1, sizeof(PricingThread));
+     if (!pricing) return NULL;
+     pricing->interval_seconds = interval_seconds > 0 ? interval_seconds : 1;
+     pthread_mutex_init(&pricing->lock, NULL);
+     pthread_cond_init(&pricing->wake, NULL);
+     if (pthread_create(&pricing->thread, NULL, pricing_worker, pricing) != 0) {
+         pthread_cond_destroy(&pricing->wake);
+         pthread_mutex_destroy(&pricing->lock);
+         free(pricing);
+         return NULL;
+     }
+     return pricing;
+ }
+ 
+ //stops the pricing thread, the last fares stay published
+ void pricing_stop(PricingThread* pricing) {
+     if (!pricing) return;
+     pthread_mutex_lock(&pricing->lock);
+     pricing->stopping = true;
+     pthread_cond_signal(&pricing->wake);
+     pthread_mutex_unlock(&pricing->lock);
+     pthread_join(pricing->thread, NULL);
+     pthread_cond_destroy(&pricing->wake);
+     pthread_mutex_destroy(&pricing->lock);
+     free(pricing);
+ }
+
+ //nanoseconds on a clock that only goes forward
+ long long monotonic_ns(void) {
+     struct timespec now;
+     clock_gettime(CLOCK_MONOTONIC, &now);
+     return now.tv_sec * 1000000000LL + now.tv_nsec;
+ }
+ 
+ //the same in microseconds, for the search deadlines
+ long long monotonic_us(void) {
+     return monotonic_ns() / 1000;
+ }
+ 
+ //the histogram bucket of a duration, values below 2 << HISTOGRAM_SUB_BITS
+ //have a bucket each, above that every power of two has the same number
+ int histogram_index(long long value) {
+     if (value < 0) value = 0;
+     if (value >= 1LL << HISTOGRAM_MAX_BITS) value = (1LL << HISTOGRAM_MAX_BITS) - 1;
+     if (value < 2LL << HISTOGRAM_SUB_BITS) return (int)value;
+     int shift = 63 - __builtin_clzll((unsigned long long)value) - HISTOGRAM_SUB_BITS;
+     return (shift << HISTOGRAM_SUB_BITS) + (int)(value >> shift);
+ }
+ 
+ //the lowest duration that goes to a bucket
+ long long histogram_value(int index) {
+     if (index < 2 << HISTOGRAM_SUB_BITS) return index;
+     int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+     return (long long)(index - (shift << HISTOGRAM_SUB_BITS)) << shift;
+ }
+ 
+ //records a phase that started at start_ns and ends now, in its histogram
+ //and in the trace ring, overwriting the oldest event once it is full
+ void phase_record(Phase phase, long long start_ns) {
+     long long end_ns = monotonic_ns();
+     long long duration = end_ns - start_ns;
+     LatencyHistogram* h = &phase_histograms[phase];
+     atomic_fetch_add_explicit(&h->counts[histogram_index(duration)], 1, memory_order_relaxed);
+     atomic_fetch_add_explicit(&h->total, 1, memory_order_relaxed);
+     atomic_fetch_add_explicit(&h->sum_ns, duration, memory_order_relaxed);
+     long long max = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+     while (duration > max && !atomic_compare_exchange_weak(&h->max_ns, &max, duration)) {
+     }
+
+     if (trace_thread == 0) trace_thread = atomic_fetch_add(&trace_threads, 1) + 1;
+     long long n = atomic_fetch_add(&trace_next, 1);
+     TraceEvent* event = &trace_events[n % MAX_TRACE_EVENTS];
+     atomic_store(&event->sequence, 0);
+     atomic_thread_fence(memory_order_release);
+     event->phase = phase;
+     event->thread = trace_thread;
+     event->start_ns = start_ns;
+     event->duration_ns = duration;
+     atomic_store_explicit(&event->sequence, n + 1, memory_order_release);
+ }
+ 
+ //the duration below which a fraction q of the recorded ones are, the upper
+ //end of the bucket it falls in, never above the longest one recorded
+ long long histogram_percentile(const long long* counts, long long total, long long max, double q) {
+     long long rank = (long long)ceil(q * total);
+     if (rank < 1) rank = 1;
+     long long seen = 0;
+     for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+         seen += counts[i];
+         if (seen >= rank) {
+             long long upper = i + 1 < HISTOGRAM_BUCKETS ? histogram_value(i + 1) - 1 : max;
+             return upper < max ? upper : max;
+         }
+     }
+     return max;
+ }
+ 
+ /*the latency of every phase so far, in microseconds, and how many queries
+ shared another one's search
+   {"phases": {"parse": {"count": 12, "mean_us": 8.1, "p50_us": 7.9, "p90_us": 11.2,
+     "p99_us": 20.4, "p999_us": 20.4, "max_us": 20.4}, ...}, "searches": {"searched": 9, "shared": 3}}
+ the accounting build adds "allocations", see alloc_stats_json
+ the counters are read while others may record, so a phase can be a few
+ events off, it is not a snapshot
+*/
+ cJSON* phase_stats_json(void) {
+     static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+     static const char* quantile_names[] = {"p50_us", "p90_us", "p99_us", "p999_us"};
+     cJSON* root = cJSON_CreateObject();
+     cJSON* phases = cJSON_CreateObject();
+     cJSON_AddItemToObject(root, "phases", phases);
+     long long* counts = (long long*)malloc(HISTOGRAM_BUCKETS * sizeof(long long));
+     for (int p = 0; p < NUM_PHASES && counts; p++) {
+         const LatencyHistogram* h = &phase_histograms[p];
+         long long total = 0;
+         for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+             counts[i] = atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+             total += counts[i];
+         }
+         long long max = atomic_load(&h->max_ns);
+         cJSON* phase = cJSON_CreateObject();
+         cJSON_AddItemToObject(phases, phase_names[p], phase);
+         cJSON_AddNumberToObject(phase, "count", (double)total);
+         if (total == 0) continue;
+         cJSON_AddNumberToObject(phase, "mean_us", atomic_load(&h->sum_ns) / 1000.0 / atomic_load(&h->total));
+         for (int q = 0; q < 4; q++) {
+             cJSON_AddNumberToObject(phase, quantile_names[q],
+                                     histogram_percentile(counts, total, max, quantiles[q]) / 1000.0);
+         }
+         cJSON_AddNumberToObject(phase, "max_us", max / 1000.0);
+     }
+     free(counts);
+
+     cJSON* searches = cJSON_CreateObject();
+     cJSON_AddItemToObject(root, "searches", searches);
+     pthread_mutex_lock(&route_flights.lock);
+     cJSON_AddNumberToObject(searches, "searched", (double)route_flights.searches);
+     cJSON_AddNumberToObject(searches, "shared", (double)route_flights.shared);
+     pthread_mutex_unlock(&route_flights.lock);
+ #ifdef ALLOC_ACCOUNTING
+     cJSON_AddItemToObject(root, "allocations", alloc_stats_json());
+ #endif
+     return root;
+ }
+ 
+ /*the events in the trace ring as a Chrome trace, to open in chrome://tracing
+ or Perfetto, every phase is a complete event on the thread that ran it
+   {"traceEvents":[{"name":"search fastest","cat":"search","ph":"X",
+     "ts":1234.567,"dur":89.012,"pid":1,"tid":3},...],"displayTimeUnit":"ms"}
+ the times are in microseconds on the monotonic clock
+ the ring can hold more events than cJSON appends quickly, so the json is
+ printed straight into a string, NULL if it could not be allocated
+*/
+ #define MAX_TRACE_EVENT_LENGTH 160
+ 
+ char* trace_json(void) {
+     long long next = atomic_load(&trace_next);
+     long long first = next > MAX_TRACE_EVENTS ? next - MAX_TRACE_EVENTS : 0;
+     size_t size = (size_t)(next - first) * MAX_TRACE_EVENT_LENGTH + 64;
+     char* json_str = (char*)malloc(size);
+     if (!json_str) return NULL;
+     size_t length = (size_t)snprintf(json_str, size, "{\"traceEvents\":[");
+     bool empty = true;
+     for (long long n = first; n < next; n++) {
+         TraceEvent* slot = &trace_events[n % MAX_TRACE_EVENTS];
+         if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != n + 1) continue;
+         TraceEvent event;
+         event.phase = slot->phase;
+         event.thread = slot->thread;
+         event.start_ns = slot->start_ns;
+         event.duration_ns = slot->duration_ns;
+         atomic_thread_fence(memory_order_acquire);
+         if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != n + 1) continue;
+
+         bool search = event.phase >= PHASE_SEARCH_CHEAPEST && event.phase <= PHASE_RECONSTRUCT;
+         length += (size_t)snprintf(json_str + length, size - length,
+             "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld.%03lld,\"dur\":%lld.%03lld,\"pid\":1,\"tid\":%d}",
+             empty ? "" : ",", phase_names[event.phase], search ? "search" : "request",
+             event.start_ns / 1000, event.start_ns % 1000, event.duration_ns / 1000, event.duration_ns % 1000,
+             event.thread);
+         empty = false;
+     }
+     snprintf(json_str + length, size - length, "],\"displayTimeUnit\":\"ms\"}");
+     return json_str;
+ }
+ 
+ //the deadline of a search that may run for ms milliseconds from now, 0 for none
+ long long search_deadline(int ms) {
+     return ms > 0 ? monotonic_us() + ms * 1000LL : 0;
+ }
+ 
+ //follows the parents from a label back to the start label the journey came
+ //from, the only labels without a flight into them, and stores the flights in
+ //travel order, false if the path is longer than MAX_PATH
+ bool reconstruct_label_path(const Label* labels, int label, int* path, int* path_size) {
+     long long started = monotonic_ns();
+     int index = labels[label].segments;
+     if (index > MAX_PATH) {
+         fprintf(stderr, "Error: Path reconstruction failed\n");
+         phase_record(PHASE_RECONSTRUCT, started);
+         return false;
+     }
+     *path_size = index;
+     for (int current = label; labels[current].flight_index >= 0; current = labels[current].parent) {
+         path[--index] = labels[current].flight_index;
+     }
+     phase_record(PHASE_RECONSTRUCT, started);
+     return true;
+ }
+ 
+ /*the searches are written once as kernels that take the route type as a
+ parameter and are instantiated for every route type, an instance gets it
+ as a constant, so the switches of calculate_route_cost and heuristic fold
+ away and the kernel is compiled for one cost function, the route type is
+ looked at once per query to pick the instance
+*/
+#if defined(__GNUC__)
+ #define SEARCH_KERNEL static inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+ #define SEARCH_KERNEL static __forceinline
+#else
+ #define SEARCH_KERNEL static inline
+#endif
+ 
+ //the heuristic towards the goal airports
+ //the heuristic can overestimate, with one goal that only costs a little
+ //optimality, but with several it steers the search to the closest goal and
+ //a cheaper journey to another one is never looked at, so a search with a
+ //group of goals runs without it, as a plain dijkstra
+ SEARCH_KERNEL Cost goal_heuristic(const Timetable* tt, int current_index, const int* goals, int num_goals,
+                                  RouteType route_type) {
+     return num_goals == 1 ? heuristic(tt, current_index, goals[0], route_type) : 0;
+ }
+ 
+ //true if journey a to an airport is as good as journey b in every way that
+ //can matter: it costs no more, has no more flights and lands at the same
+ //time having taken no longer
+ //the rule is the same with and without limits, so limits that do not bind
+ //leave the answer as it is
+ static inline bool label_dominates(const Label* a, const Label* b) {
+     return a->g_cost <= b->g_cost && a->segments <= b->segments &&
+            a->arrival_day == b->arrival_day && a->arrival_time == b->arrival_time &&
+            a->elapsed <= b->elapsed;
+ }
+ 
+ /*the route search of find_optimal_path_kernel: the cost of a flight counts
+ the wait for it, so a journey that costs more to an airport on the way but
+ lands earlier can lead to a cheaper one, and with a limit on the flights,
+ the layover or the duration it can be the only one that keeps to them,
+ so instead of one node per airport the search keeps a label for every
+ journey no other journey to its airport dominates, see label_dominates,
+ and expands them in f cost order, the first goal label taken out of the
+ queue is the answer
+*/
+ SEARCH_KERNEL bool find_label_path_kernel(const Timetable* tt, const Cost* fare, SearchContext* ctx,
+                       const int* start_airports, int num_starts, const int* goal_airports, int num_goals,
+                       const bool* is_goal, int start_day_index, int departure_time, RouteType route_type,
+                       int max_segments, int max_layover, int max_duration, const bool* excluded,
+                       long long deadline_us, int* path, int* path_size, bool* out_of_time) {
+     for (int s = 0; s < num_starts; s++) {
+         int start_index = start_airports[s];
+         search_context_visit(ctx, start_index);
+         if (ctx->label_head[start_index] >= 0) continue;
+         int l = search_context_add_label(ctx);
+         if (l < 0) {
+             fprintf(stderr, "Error: Memory allocation failed\n");
+             return false;
+         }
+         Label* start = &ctx->labels[l];
+         start->g_cost = 0;
+         start->f_cost = goal_heuristic(tt, start_index, goal_airports, num_goals, route_type);
+         start->airport_index = start_index;
+         start->parent = -1;
+         start->flight_index = -1;
+         start->arrival_time = departure_time;
+         start->arrival_day = start_day_index;
+         start->segments = 0;
+         start->elapsed = 0;
+         start->next = -1;
+         start->dominated = false;
+         ctx->label_head[start_index] = l;
+         label_queue_push(ctx, l);
+     }
+     
+     Cost goal_cost = INFINITY_COST;
+     int best_goal = -1;
+     while (ctx->label_queue_size > 0) {
+         if (deadline_us > 0 && monotonic_us() >= deadline_us) {
+             *out_of_time = true;
+             break;
+         }
+         int current_label = label_queue_pop(ctx);
+         //a copy, the labels can move when new ones are added
+         Label current = ctx->labels[current_label];
+         if (current.dominated) continue;
+         int current_index = current.airport_index;
+         if (is_goal[current_index]) {
+             return reconstruct_label_path(ctx->labels, current_label, path, path_size);
+         }
+         if (current.segments >= max_segments)
+             continue;
+         bool connecting = current.flight_index >= 0;
+         
+         const DepartureList* outgoing = &tt->departures[current_index];
+         const char* arrival_day = day_name(current.arrival_day);
+         int min_connection = tt->airports[current_index].min_waiting_time;
+         for (int offset = 0; offset < 7; offset++) {
+             int begin, end;
+             connection_day_range(outgoing, current.arrival_day, offset, current.arrival_time, min_connection, &begin, &end);
+             for (int k = begin; k < end; k++) {
+                 int i = outgoing->flights[k].flight_index;
+                 int wait = calculate_wait_time(current.arrival_time, arrival_day,
+                                                tt->flights[i].departure_time, tt->flights[i].day_of_week);
+                 if (current.g_cost + calculate_route_cost(route_type, 0, wait, 0.0) >= goal_cost)
+                     break;
+                 int layover = connecting ? wait : 0;
+                 if (layover > max_layover || current.elapsed + layover > max_duration)
+                     break;
+                 if (!tt->flights[i].available || flight_sold_out(tt, i))
+                     continue;
+                 int next_index = tt->flights[i].to_index;
+                 if (next_index < 0 || (excluded && excluded[next_index]))
+                     continue;
+                 int journey_time = current.elapsed + layover + tt->flights[i].duration;
+                 if (journey_time > max_duration)
+                     continue;
+                 Cost total_cost = current.g_cost + calculate_route_cost(
+                     route_type,
+                     fare ? fare[i] : tt->flights[i].cost,
+                     tt->flights[i].duration + wait,
+                     tt->flights[i].distance
+                 );
+                 //no journey through here can beat the goal airport already reached
+                 if (total_cost >= goal_cost)
+                     continue;
+                 
+                 Label next;
+                 next.g_cost = total_cost;
+                 next.airport_index = next_index;
+                 next.parent = current_label;
+                 next.flight_index = i;
+                 next.arrival_time = tt->flights[i].arrival_time;
+                 next.arrival_day = flight_arrival_day(&tt->flights[i], outgoing->flights[k].minute_of_week);
+                 next.segments = current.segments + 1;
+                 next.elapsed = journey_time;
+                 next.dominated = false;
+                 
+                 //drop the journey if one kept at the airport is as good, else
+                 //drop the kept ones it is as good as
+                 search_context_visit(ctx, next_index);
+                 bool dominated = false;
+                 int* link = &ctx->label_head[next_index];
+                 while (*link >= 0) {
+                     Label* kept = &ctx->labels[*link];
+                     if (label_dominates(kept, &next)) {
+                         dominated = true;
+                         break;
+                     }
+                     if (label_dominates(&next, kept)) {
+                         kept->dominated = true;
+                         *link = kept->next;
+                     } else {
+                         link = &kept->next;
+                     }
+                 }
+                 if (dominated)
+                     continue;
+                 //the heuristic takes a few trigonometric calls, only the labels kept need it
+                 next.f_cost = total_cost + goal_heuristic(tt, next_index, goal_airports, num_goals, route_type);
+                 int l = search_context_add_label(ctx);
+                 if (l < 0) {
+                     fprintf(stderr, "Error: Memory allocation failed\n");
+                     return false;
+                 }
+                 next.next = ctx->label_head[next_index];
+                 ctx->labels[l] = next;
+                 ctx->label_head[next_index] = l;
+                 label_queue_push(ctx, l);
+                 if (is_goal[next_index]) {
+                     goal_cost = total_cost;
+                     best_goal = l;
+                 }
+             }
+         }
+     }
+     
+     //out of time, the cheapest journey to a goal airport found so far
+     if (*out_of_time && best_goal >= 0) {
+         return reconstruct_label_path(ctx->labels, best_goal, path, path_size);
+     }
+     return false;
+ }
+ 
+ /* Implements the A* algorithm in order to find the optimal path between 2 airports
+ it uses the priority queue data structure for better performance
+ start_code and goal_code -> mean the code of the starting airport and
+ the code of the destination airport, either can be the code of a group of
+ airports: the search then starts from all the start airports at once, as if
+ a virtual source had a free flight to each of them, and ends at the first
+ goal airport it takes out of the queue, as if they all led to a virtual
+ sink, so one search answers for every pair of airports of the two groups
+ tt is the timetable snapshot the search runs on, it is only read
+ fares are the current fares, NULL to use the static costs of the flights
+ ctx holds the scratch state, it must not be shared by concurrent searches
+ also departure time is in minutes after midnight
+ constraints are the limits the journey has to keep to, NULL for none
+ deadline_us is when the search has to give an answer, see search_deadline,
+ a search still running then answers with the cheapest journey to a goal
+ airport it has found so far, if any, and sets best_effort, which can be NULL
+ path stored the flight indices in the optimal path
+ path_size stores the number of flights in the path
+ this is the kernel, find_optimal_path runs its instance for the route type
+  */
+ SEARCH_KERNEL bool find_optimal_path_kernel(const Timetable* tt, const FareTable* fares, SearchContext* ctx,
+                       const char* start_code, const char* goal_code, 
+                       const char* start_day, int departure_time, 
+                       RouteType route_type, const SearchConstraints* constraints,
+                       long long deadline_us, int* path, int* path_size, bool* best_effort) {
+     if (best_effort) *best_effort = false;
+     //the current economy fares if they were priced from tt, else the static costs
+     const Cost* fare = snapshot_fares(tt, fares, ECONOMY);
+     
+     //finding indices of the airports, one or more for each code
+     int start_airports[MAX_GROUP_AIRPORTS];
+     int goal_airports[MAX_GROUP_AIRPORTS];
+     int num_starts = find_airport_set(tt, start_code, start_airports);
+     int num_goals = find_airport_set(tt, goal_code, goal_airports);
+     
+     //validating airport codes
+     if (num_starts == 0 || num_goals == 0) {
+         fprintf(stderr, "Error: Invalid airport codes (%s or %s not found)\n", 
+                 start_code, goal_code);
+         return false;
+     }
+     int start_day_index = find_day_index(start_day);
+     if (start_day_index < 0) {
+         fprintf(stderr, "Error: Invalid day %s\n", start_day);
+         return false;
+     }
+     bool is_goal[MAX_AIRPORTS] = {false};
+     for (int g = 0; g < num_goals; g++) {
+         is_goal[goal_airports[g]] = true;
+     }
+     
+     //the limits, a path never has more than MAX_PATH flights so it can
+     //always be reconstructed
+     int max_segments = MAX_PATH;
+     int max_layover = INT_MAX;
+     int max_duration = INT_MAX;
+     const bool* excluded = NULL;
+     if (constraints) {
+         if (constraints->max_segments > 0 && constraints->max_segments < MAX_PATH)
+             max_segments = constraints->max_segments;
+         if (constraints->max_layover > 0) max_layover = constraints->max_layover;
+         if (constraints->max_duration > 0) max_duration = constraints->max_duration;
+         excluded = constraints->excluded;
+     }
+ 
+     //the labels come from the context and the airports are initialized lazily
+     search_context_reset(ctx);
+     bool out_of_time = false;
+     bool found = find_label_path_kernel(tt, fare, ctx, start_airports, num_starts, goal_airports,
+                                               num_goals, is_goal, start_day_index, departure_time,
+                                               route_type, max_segments, max_layover, max_duration,
+                                               excluded, deadline_us, path, path_size, &out_of_time);
+     if (out_of_time && best_effort) *best_effort = true;
+     if (!found) {
+         if (out_of_time) fprintf(stderr, "Error: Search from %s to %s ran out of time\n", start_code, goal_code);
+         else fprintf(stderr, "Error: No viable path found from %s to %s\n", start_code, goal_code);
+     }
+     return found;
+ }
+ 
+ //an instance of the search kernel for one route type
+ #define DEFINE_ROUTE_SEARCH(name, type) \
+ bool name(const Timetable* tt, const FareTable* fares, SearchContext* ctx, \
+           const char* start_code, const char* goal_code, const char* start_day, \
+           int departure_time, const SearchConstraints* constraints, long long deadline_us, \
+           int* path, int* path_size, bool* best_effort) { \
+     return find_optimal_path_kernel(tt, fares, ctx, start_code, goal_code, start_day, departure_time, \
+                                     type, constraints, deadline_us, path, path_size, best_effort); \
+ }
+ 
+ DEFINE_ROUTE_SEARCH(find_optimal_path_cheapest, CHEAPEST)
+ DEFINE_ROUTE_SEARCH(find_optimal_path_fastest, FASTEST)
+ DEFINE_ROUTE_SEARCH(find_optimal_path_optimal, OPTIMAL)
+ 
+ //finds the best path for a route type, see find_optimal_path_kernel
+ bool find_optimal_path(const Timetable* tt, const FareTable* fares, SearchContext* ctx,
+                       const char* start_code, const char* goal_code, 
+                       const char* start_day, int departure_time, 
+                       RouteType route_type, const SearchConstraints* constraints,
+                       long long deadline_us, int* path, int* path_size, bool* best_effort) {
+     switch (route_type) {
+         case CHEAPEST:
+             return find_optimal_path_cheapest(tt, fares, ctx, start_code, goal_code, start_day,
+                                               departure_time, constraints, deadline_us, path, path_size, best_effort);
+         case FASTEST:
+             return find_optimal_path_fastest(tt, fares, ctx, start_code, goal_code, start_day,
+                                              departure_time, constraints, deadline_us, path, path_size, best_effort);
+         case OPTIMAL:
+             return find_optimal_path_optimal(tt, fares, ctx, start_code, goal_code, start_day,
+                                              departure_time, constraints, deadline_us, path, path_size, best_effort);
+         default:
+             fprintf(stderr, "Invalid route type\n");
+             return false;
+     }
+ }
+
+ //runs one task and tells its batch that it is finished
+ //a worker that could not get a context still finishes its tasks, as not found
+ void run_search_task(SearchTask* task, SearchContext* ctx) {
+     long long started = monotonic_ns();
+     AllocSite previous_site = alloc_site_enter(ALLOC_SEARCH);
+     task->path_size = 0;
+     task->best_effort = false;
+     task->found = ctx && find_optimal_path(task->tt, task->fares, ctx, task->from, task->to, task->day,
+                                            task->departure_time, task->route_type, task->constraints,
+                                            task->deadline_us, task->path, &task->path_size,
+                                            &task->best_effort);
+     alloc_site_leave(previous_site);
+     phase_record((Phase)(PHASE_SEARCH_CHEAPEST + task->route_type), started);
+     pthread_mutex_lock(&task->batch->lock);
+     if (--task->batch->pending == 0) pthread_cond_signal(&task->batch->done);
+     pthread_mutex_unlock(&task->batch->lock);
+ }
+ 
+ //worker thread, takes tasks from the pool until it is stopped
+ void* search_worker(void* arg) {
+     block_server_signals();
+     WorkerPool* pool = (WorkerPool*)arg;
+     SearchContext* ctx = search_context_create();
+     
+     pthread_mutex_lock(&pool->lock);
+     while (true) {
+         while (!pool->head && !pool->stopping) {
+             pthread_cond_wait(&pool->has_work, &pool->lock);
+         }
+         if (!pool->head) break;
+         SearchTask* task = pool->head;
+         pool->head = task->next;
+         if (!pool->head) pool->tail = NULL;
+         pthread_mutex_unlock(&pool->lock);
+         
+         run_search_task(task, ctx);
+         
+         pthread_mutex_lock(&pool->lock);
+     }
+     pthread_mutex_unlock(&pool->lock);
+     
+     search_context_destroy(ctx);
+     return NULL;
+ }
+ 
+ //starts the search threads, returns NULL if none could be started
+ WorkerPool* worker_pool_create(int num_workers) {
+     WorkerPool* pool = (WorkerPool*)calloc(1, sizeof(WorkerPool));
+     if (!pool) return NULL;
+     pool->workers = (pthread_t*)malloc(num_workers * sizeof(pthread_t));
+     if (!pool->workers) {
+         free(pool);
+         return NULL;
+     }
+     pthread_mutex_init(&pool->lock, NULL);
+     pthread_cond_init(&pool->has_work, NULL);
+     
+     for (int i = 0; i < num_workers; i++) {
+         if (pthread_create(&pool->workers[pool->num_workers], NULL, search_worker, pool) == 0)
+             pool->num_workers++;
+     }
+     if (pool->num_workers == 0) {
+         pthread_cond_destroy(&pool->has_work);
+         pthread_mutex_destroy(&pool->lock);
+         free(pool->workers);
+         free(pool);
+         return NULL;
+     }
+     return pool;
+ }
+ 
+ //lets the workers finish the queued tasks and joins them
+ void worker_pool_destroy(WorkerPool* pool) {
+     if (!pool) return;
+     pthread_mutex_lock(&pool->lock);
+     pool->stopping = true;
+     pthread_cond_broadcast(&pool->has_work);
+     pthread_mutex_unlock(&pool->lock);
+     
+     for (int i = 0; i < pool->num_workers; i++) {
+         pthread_join(pool->workers[i], NULL);
+     }
+     pthread_cond_destroy(&pool->has_work);
+     pthread_mutex_destroy(&pool->lock);
+     free(pool->workers);
+     free(pool);
+ }
+ 
+ /* runs a batch of searches on the pool and waits for all of them
+ the searches are independent, so the batch takes as long as its slowest search
+ without a pool they run one after another on ctx
+ */
+ void run_search_batch(WorkerPool* pool, SearchContext* ctx, SearchTask* tasks, int count) {
+     SearchBatch batch;
+     pthread_mutex_init(&batch.lock, NULL);
+     pthread_cond_init(&batch.done, NULL);
+     batch.pending = count;
+     
+     for (int i = 0; i < count; i++) {
+         tasks[i].batch = &batch;
+         tasks[i].next = NULL;
+     }
+     
+     if (pool) {
+         pthread_mutex_lock(&pool->lock);
+         for (int i = 0; i < count; i++) {
+             if (pool->tail) pool->tail->next = &tasks[i];
+             else pool->head = &tasks[i];
+             pool->tail = &tasks[i];
+         }
+         pthread_cond_broadcast(&pool->has_work);
+         pthread_mutex_unlock(&pool->lock);
+         
+         pthread_mutex_lock(&batch.lock);
+         while (batch.pending > 0) {
+             pthread_cond_wait(&batch.done, &batch.lock);
+         }
+         pthread_mutex_unlock(&batch.lock);
+     } else {
+         for (int i = 0; i < count; i++) {
+             run_search_task(&tasks[i], ctx);
+         }
+     }
+     
+     pthread_cond_destroy(&batch.done);
+     pthread_mutex_destroy(&batch.lock);
+ }
+ 
+ //fills in one task per route type for the same query, constraints can be NULL
+ //and a deadline_us of 0 lets the searches run to the end
+ void init_route_tasks(SearchTask* tasks, const Timetable* tt, const FareTable* fares, const char* from,
+                       const char* to, const char* day, int departure_time,
+                       const SearchConstraints* constraints, long long deadline_us) {
+     for (int r = 0; r < NUM_ROUTE_TYPES; r++) {
+         tasks[r].tt = tt;
+         tasks[r].fares = fares;
+         tasks[r].from = from;
+         tasks[r].to = to;
+         tasks[r].day = day;
+         tasks[r].departure_time = departure_time;
+         tasks[r].route_type = (RouteType)r;
+         tasks[r].constraints = constraints;
+         tasks[r].deadline_us = deadline_us;
+         tasks[r].path_size = 0;
+         tasks[r].found = false;
+         tasks[r].best_effort = false;
+     }
+ }
+ 
+ /*reads the constraints of a query from json, for the airports of tt
+   {"max_segments": 2, "max_layover": 180, "max_duration": 720, "avoid": ["CDG", "LON"]}
+ every field can be left out, an airport to avoid can be the code of a group
+ returns false if a field has the wrong type or an airport is unknown, with
+ the reason in error, which has room for MAX_ERROR_LENGTH characters
+*/
+ bool parse_search_constraints(const Timetable* tt, cJSON* json, SearchConstraints* constraints, char* error) {
+     memset(constraints, 0, sizeof(*constraints));
+     if ((json->type & 0xFF) != cJSON_Object) {
+         snprintf(error, MAX_ERROR_LENGTH, "Constraints must be an object");
+         return false;
+     }
+     const char* limits[] = {"max_segments", "max_layover", "max_duration"};
+     int* values[] = {&constraints->max_segments, &constraints->max_layover, &constraints->max_duration};
+     for (int l = 0; l < 3; l++) {
+         cJSON* limit = cJSON_GetObjectItem(json, limits[l]);
+         if (!limit) continue;
+         if ((limit->type & 0xFF) != cJSON_Number || limit->valueint < 0) {
+             snprintf(error, MAX_ERROR_LENGTH, "Constraint %s must be a number of at least 0", limits[l]);
+             return false;
+         }
+         *values[l] = limit->valueint;
+     }
+     
+     cJSON* avoid = cJSON_GetObjectItem(json, "avoid");
+     if (!avoid) return true;
+     if ((avoid->type & 0xFF) != cJSON_Array) {
+         snprintf(error, MAX_ERROR_LENGTH, "Constraint avoid must be an array of airport codes");
+         return false;
+     }
+     for (cJSON* code = avoid->child; code; code = code->next) {
+         int airports[MAX_GROUP_AIRPORTS];
+         bool is_string = (code->type & 0xFF) == cJSON_String;
+         int count = is_string ? find_airport_set(tt, code->valuestring, airports) : 0;
+         if (count == 0) {
+             snprintf(error, MAX_ERROR_LENGTH, "Unknown airport to avoid (%s)",
+                      is_string ? code->valuestring : "not a code");
+             return false;
+         }
+         for (int a = 0; a < count; a++) {
+             constraints->excluded[airports[a]] = true;
+         }
+     }
+     return true;
+ }
+
+ //one flight of a journey in the output format
+ cJSON* create_segment_json(const Timetable* tt, const FareTable* fares, int flight_index) {
+     const ScheduledFlight* f = &tt->flights[flight_index];
+     char time_str[MAX_TIME_LENGTH];
+     cJSON* segment = cJSON_CreateObject();
+     cJSON_AddStringToObject(segment, "from", f->from);
+     cJSON_AddStringToObject(segment, "to", f->to);
+     cJSON_AddStringToObject(segment, "day", f->day_of_week);
+     minutes_to_time(f->departure_time, time_str);
+     cJSON_AddStringToObject(segment, "departure_time", time_str);
+     minutes_to_time(f->arrival_time, time_str);
+     cJSON_AddStringToObject(segment, "arrival_time", time_str);
+     cJSON_AddNumberToObject(segment, "duration", f->duration);
+     cJSON_AddNumberToObject(segment, "cost", cost_to_double(flight_fare(tt, fares, flight_index)));
+     //what booking the flight costs in each cabin, cost is the economy one
+     cJSON* cabin_fares = cJSON_CreateObject();
+     for (int c = 0; c < NUM_CABINS; c++) {
+         cJSON_AddNumberToObject(cabin_fares, cabin_names[c], cost_to_double(cabin_fare(tt, fares, flight_index, (CabinClass)c)));
+     }
+     cJSON_AddItemToObject(segment, "fares", cabin_fares);
+     cJSON_AddNumberToObject(segment, "distance", f->distance);
+     return segment;
+ }
+ 
+ /* profile search: every journey worth taking from one airport to another
+ that leaves inside a departure window, in a single run
+ a journey is kept if no other one leaves later, arrives earlier and costs
+ less (at least as good in all three and better in one), so the result is
+ the pareto set of (departure, arrival, cost)
+ it is a reverse connection scan: the flights become connections on a
+ timeline in minutes from monday 00:00, repeated for the following weeks,
+ and are scanned from the latest departure to the earliest
+ every airport keeps the journeys to the destination found so far, in the
+ order they were found, that is by decreasing departure, a connection into
+ an airport extends the journeys leaving there after the connection time
+*/
+ 
+ //a flight on the profile timeline
+ typedef struct {
+     int flight_index;
+     int departure;   //minutes from monday 00:00 of the first week
+     int arrival;
+ } ProfileConnection;
+ 
+ //a journey from an airport to the destination, first leg and the rest
+ typedef struct {
+     int departure;
+     int arrival;
+     Cost cost;
+     int connection;  //first leg, index into the connections
+     int next;        //the journey the first leg connects to, -1 at the destination
+ } ProfileEntry;
+ 
+ int compare_connections_by_departure(const void* a, const void* b) {
+     const ProfileConnection* x = (const ProfileConnection*)a;
+     const ProfileConnection* y = (const ProfileConnection*)b;
+     //latest first, the scan goes backwards in time
+     return (y->departure > x->departure) - (y->departure < x->departure);
+ }
+ 
+ /*the journeys of one airport, as positions in the entry pool
+ entries are by decreasing departure, front is the same journeys without
+ the departure: the ones no other beats on arrival and cost, by increasing
+ arrival and so by decreasing cost, a journey found later leaves no later
+ than any in the bag, so it only has to beat the front
+*/
+ typedef struct {
+     int* entries;
+     int count;
+     int capacity;
+     int* front;
+     int front_count;
+     int front_capacity;
+ } ProfileBag;
+ 
+ bool profile_grow(int** array, int* capacity, int needed) {
+     if (needed <= *capacity) return true;
+     int grown_capacity = *capacity ? *capacity * 2 : 16;
+     int* grown = (int*)realloc(*array, grown_capacity * sizeof(int));
+     if (!grown) return false;
+     *array = grown;
+     *capacity = grown_capacity;
+     return true;
+ }
+ 
+ //position of the first front journey arriving at or after arrival
+ int profile_front_position(const ProfileBag* bag, const ProfileEntry* pool, int arrival) {
+     int lo = 0, hi = bag->front_count;
+     while (lo < hi) {
+         int mid = (lo + hi) / 2;
+         if (pool[bag->front[mid]].arrival < arrival) lo = mid + 1;
+         else hi = mid;
+     }
+     return lo;
+ }
+ 
+ //true if a journey in the bag arrives no later for no more
+ bool profile_dominated(const ProfileBag* bag, const ProfileEntry* pool, int arrival, Cost cost) {
+     int k = profile_front_position(bag, pool, arrival + 1) - 1;
+     //the front journey arriving last by then is the cheapest of those
+     return k >= 0 && pool[bag->front[k]].cost <= cost;
+ }
+ 
+ //adds a journey that is not dominated, the ones it beats leave the front and,
+ //if they leave at the same time, the bag
+ bool profile_bag_add(ProfileBag* bag, ProfileEntry* pool, int entry) {
+     const ProfileEntry* e = &pool[entry];
+     //the journeys leaving at the same time are at the end of the bag
+     int first = bag->count;
+     while (first > 0 && pool[bag->entries[first - 1]].departure == e->departure) first--;
+     int kept = first;
+     for (int k = first; k < bag->count; k++) {
+         const ProfileEntry* other = &pool[bag->entries[k]];
+         if (other->arrival < e->arrival || other->cost < e->cost) bag->entries[kept++] = bag->entries[k];
+     }
+     bag->count = kept;
+     if (!profile_grow(&bag->entries, &bag->capacity, bag->count + 1) ||
+         !profile_grow(&bag->front, &bag->front_capacity, bag->front_count + 1))
+         return false;
+     bag->entries[bag->count++] = entry;
+     
+     int position = profile_front_position(bag, pool, e->arrival);
+     int end = position;
+     while (end < bag->front_count && pool[bag->front[end]].cost >= e->cost) end++;
+     memmove(&bag->front[position + 1], &bag->front[end], (bag->front_count - end) * sizeof(int));
+     bag->front_count += position + 1 - end;
+     bag->front[position] = entry;
+     return true;
+ }
+ 
+ /* runs the profile search for departures from window_start up to, not including,
+ window_start + window (minutes from monday 00:00, the window is at most a
+ week), journeys may end up to MAX_PROFILE_HORIZON after the window
+ returns the pareto journeys leaving the origin as a json object, NULL on errors
+*/
+ cJSON* profile_search(const Timetable* tt, const FareTable* fares, const char* from, const char* to,
+                       int window_start, int window) {
+     int origin = find_airport_index(tt, from);
+     int destination = find_airport_index(tt, to);
+     if (origin < 0 || destination < 0 || origin == destination) {
+         fprintf(stderr, "Error: Invalid airport codes for the profile search (%s, %s)\n", from, to);
+         return NULL;
+     }
+     //the departure time is not checked by the callers, wrap it into the week
+     window_start = (window_start % MINUTES_PER_WEEK + MINUTES_PER_WEEK) % MINUTES_PER_WEEK;
+     if (window < 1) window = 1;
+     if (window > MINUTES_PER_WEEK) window = MINUTES_PER_WEEK;
+     int window_end = window_start + window;
+     int horizon_end = window_end + MAX_PROFILE_HORIZON;
+     
+     //every flight once per week the timeline covers
+     int weeks = horizon_end / MINUTES_PER_WEEK + 1;
+     ProfileConnection* connections = (ProfileConnection*)malloc(
+         ((size_t)tt->num_flights * weeks + 1) * sizeof(ProfileConnection));
+     ProfileBag* bags = (ProfileBag*)calloc(tt->num_airports, sizeof(ProfileBag));
+     int pool_capacity = 1024;
+     ProfileEntry* pool = (ProfileEntry*)malloc(pool_capacity * sizeof(ProfileEntry));
+     if (!connections || !bags || !pool) {
+         fprintf(stderr, "Error: Memory allocation failed\n");
+         free(connections);
+         free(bags);
+         free(pool);
+         return NULL;
+     }
+     int num_connections = 0;
+     for (int i = 0; i < tt->num_flights; i++) {
+         const ScheduledFlight* f = &tt->flights[i];
+         if (!f->available || f->from_index < 0 || f->to_index < 0 || flight_sold_out(tt, i)) continue;
+         int departure = find_day_index(f->day_of_week) * 1440 + f->departure_time;
+         for (int w = 0; w < weeks; w++) {
+             int d = departure + w * MINUTES_PER_WEEK;
+             if (d < window_start || d + f->duration > horizon_end) continue;
+             connections[num_connections].flight_index = i;
+             connections[num_connections].departure = d;
+             connections[num_connections].arrival = d + f->duration;
+             num_connections++;
+         }
+     }
+     qsort(connections, num_connections, sizeof(ProfileConnection), compare_connections_by_departure);
+     
+     int pool_size = 0;
+     bool ok = true;
+     for (int c = 0; c < num_connections && ok; c++) {
+         const ProfileConnection* conn = &connections[c];
+         const ScheduledFlight* f = &tt->flights[conn->flight_index];
+         int u = f->from_index;
+         int v = f->to_index;
+         if (u == destination || v == origin) continue;
+         Cost cost = flight_fare(tt, fares, conn->flight_index);
+         
+         //journeys this connection starts: straight to the destination or on
+         //with a journey that leaves v late enough to make the connection
+         int first = 0, last = 0;
+         if (v != destination) {
+             //the bag of v is sorted by decreasing departure, the ones that
+             //leave after the connection time are a prefix of it
+             int earliest = conn->arrival + tt->airports[v].min_waiting_time;
+             const ProfileBag* next_bag = &bags[v];
+             int lo = 0, hi = next_bag->count;
+             while (lo < hi) {
+                 int mid = (lo + hi) / 2;
+                 if (pool[next_bag->entries[mid]].departure >= earliest) lo = mid + 1;
+                 else hi = mid;
+             }
+             last = lo;
+         } else {
+             first = -1;
+         }
+         
+         for (int k = first; k < last && ok; k++) {
+             int next = k < 0 ? -1 : bags[v].entries[k];
+             int arrival = next < 0 ? conn->arrival : pool[next].arrival;
+             Cost total = cost + (next < 0 ? 0 : pool[next].cost);
+             if (profile_dominated(&bags[u], pool, arrival, total)) continue;
+             
+             if (pool_size == pool_capacity) {
+                 if (pool_capacity >= MAX_PROFILE_ENTRIES) {
+                     fprintf(stderr, "Error: Profile search from %s to %s has too many journeys\n", from, to);
+                     ok = false;
+                     break;
+                 }
+                 pool_capacity *= 2;
+                 ProfileEntry* grown = (ProfileEntry*)realloc(pool, pool_capacity * sizeof(ProfileEntry));
+                 if (!grown) {
+                     fprintf(stderr, "Error: Memory allocation failed\n");
+                     ok = false;
+                     break;
+                 }
+                 pool = grown;
+             }
+             pool[pool_size].departure = conn->departure;
+             pool[pool_size].arrival = arrival;
+             pool[pool_size].cost = total;
+             pool[pool_size].connection = c;
+             pool[pool_size].next = next;
+             if (!profile_bag_add(&bags[u], pool, pool_size)) {
+                 fprintf(stderr, "Error: Memory allocation failed\n");
+                 ok = false;
+                 break;
+             }
+             pool_size++;
+         }
+     }
+     
+     cJSON* root = NULL;
+     if (ok) {
+         root = cJSON_CreateObject();
+         cJSON_AddStringToObject(root, "origin", from);
+         cJSON_AddStringToObject(root, "destination", to);
+         char time_str[MAX_TIME_LENGTH];
+         minutes_to_time(window_start % 1440, time_str);
+         cJSON_AddStringToObject(root, "window_start_day", days_of_week[window_start / 1440 % 7]);
+         cJSON_AddStringToObject(root, "window_start_time", time_str);
+         cJSON_AddNumberToObject(root, "window_minutes", window);
+         
+         //the origin bag is by decreasing departure, the answer goes by increasing
+         cJSON* journeys = cJSON_CreateArray();
+         const ProfileBag* bag = &bags[origin];
+         for (int k = bag->count - 1; k >= 0; k--) {
+             const ProfileEntry* e = &pool[bag->entries[k]];
+             if (e->departure >= window_end) continue;
+             
+             cJSON* journey = cJSON_CreateObject();
+             minutes_to_time(e->departure % 1440, time_str);
+             cJSON_AddStringToObject(journey, "departure_day", days_of_week[e->departure / 1440 % 7]);
+             cJSON_AddStringToObject(journey, "departure_time", time_str);
+             minutes_to_time(e->arrival % 1440, time_str);
+             cJSON_AddStringToObject(journey, "arrival_day", days_of_week[e->arrival / 1440 % 7]);
+             cJSON_AddStringToObject(journey, "arrival_time", time_str);
+             cJSON_AddNumberToObject(journey, "total_cost", cost_to_double(e->cost));
+             cJSON_AddNumberToObject(journey, "total_duration", e->arrival - e->departure);
+             cJSON* segments = cJSON_CreateArray();
+             for (int n = bag->entries[k]; n >= 0; n = pool[n].next) {
+                 cJSON_AddItemToArray(segments, create_segment_json(tt, fares, connections[pool[n].connection].flight_index));
+             }
+             cJSON_AddItemToObject(journey, "segments", segments);
+             cJSON_AddItemToArray(journeys, journey);
+         }
+         cJSON_AddItemToObject(root, "journeys", journeys);
+     }
+     
+     for (int a = 0; a < tt->num_airports; a++) {
+         free(bags[a].entries);
+         free(bags[a].front);
+     }
+     free(bags);
+     free(pool);
+     free(connections);
+     return root;
+ }
+ 
+ //the budget a reachability query is bounded by, by route type
+ const char* budget_metric_names[NUM_ROUTE_TYPES] = {"cost", "duration", "optimal"};
+ 
+ //returns the route type of a budget metric name, or -1 if it is not one
+ int find_budget_metric(const char* name) {
+     for (int r = 0; r < NUM_ROUTE_TYPES; r++) {
+         if (strcmp(name, budget_metric_names[r]) == 0) return r;
+     }
+     return -1;
+ }
+ 
+ /* reachability query: every airport that can be reached from an origin
+ within a budget, with the best journey to each
+ it is the search of find_optimal_path without a goal and without the
+ heuristic, so it is a plain dijkstra: the airports are closed in order of
+ their route cost and the search stops at the first one over the budget,
+ one run answers for all airports where one search per destination would
+ be needed otherwise
+ the budget is in the unit of the route type: money for CHEAPEST, minutes
+ of flying and waiting for FASTEST, the weighted sum for OPTIMAL
+ the kernel leaves the journeys in the nodes of ctx, stores the airports it
+ reached in the order they were closed, that is by route cost, and returns
+ how many there are, the origin first
+*/
+ SEARCH_KERNEL int reachability_kernel(const Timetable* tt, const Cost* fare, SearchContext* ctx,
+                                       int start_index, const char* start_day, int departure_time,
+                                       RouteType route_type, Cost budget, int* reached) {
+     search_context_reset(ctx);
+     bool* closed_set = ctx->closed_set;
+     Node* nodes = ctx->nodes;
+     PriorityQueue* open_set = &ctx->open_set;
+ 
+     search_context_visit(ctx, start_index);
+     nodes[start_index].g_cost = 0;
+     nodes[start_index].f_cost = 0;
+     nodes[start_index].arrival_time = departure_time;
+     nodes[start_index].arrival_day = find_day_index(start_day);
+     pq_enqueue(open_set, start_index, 0);
+ 
+     int num_reached = 0;
+ 
+     while (open_set->size > 0) {
+         int current_index = pq_dequeue(open_set);
+         const Node* current = &nodes[current_index];
+         //everything left in the queue is over the budget as well
+         if (current->g_cost > budget)
+             break;
+         closed_set[current_index] = true;
+         reached[num_reached++] = current_index;
+ 
+         const DepartureList* outgoing = &tt->departures[current_index];
+         const char* arrival_day = day_name(current->arrival_day);
+         int min_connection = tt->airports[current_index].min_waiting_time;
+         for (int offset = 0; offset < 7; offset++) {
+             int begin, end;
+             connection_day_range(outgoing, current->arrival_day, offset, current->arrival_time, min_connection, &begin, &end);
+             for (int k = begin; k < end; k++) {
+                 int i = outgoing->flights[k].flight_index;
+                 int wait = calculate_wait_time(current->arrival_time, arrival_day,
+                                                tt->flights[i].departure_time, tt->flights[i].day_of_week);
+                 //the rest of the day waits longer, so it is over the budget too
+                 if (current->g_cost + calculate_route_cost(route_type, 0, wait, 0.0) > budget)
+                     break;
+                 if (!tt->flights[i].available || flight_sold_out(tt, i))
+                     continue;
+                 int next_index = tt->flights[i].to_index;
+                 if (next_index < 0)
+                     continue;
+                 search_context_visit(ctx, next_index);
+                 if (closed_set[next_index])
+                     continue;
+ 
+                 Cost total_cost = current->g_cost + calculate_route_cost(
+                     route_type,
+                     fare ? fare[i] : tt->flights[i].cost,
+                     tt->flights[i].duration + wait,
+                     tt->flights[i].distance
+                 );
+                 //an airport over the budget is never reported, so it is not queued either
+                 Node* neighbor = &nodes[next_index];
+                 if (total_cost > budget || total_cost >= neighbor->g_cost)
+                     continue;
+ 
+                 neighbor->g_cost = total_cost;
+                 neighbor->f_cost = total_cost;
+                 neighbor->parent_index = current_index;
+                 neighbor->flight_index = i;
+                 neighbor->arrival_time = tt->flights[i].arrival_time;
+                 neighbor->arrival_day = flight_arrival_day(&tt->flights[i], outgoing->flights[k].minute_of_week);
+                 pq_enqueue(open_set, next_index, total_cost);
+             }
+         }
+     }
+     return num_reached;
+ }
+ 
+ #define DEFINE_REACHABILITY_SEARCH(name, type) \
+ int name(const Timetable* tt, const Cost* fare, SearchContext* ctx, int start_index, \
+          const char* start_day, int departure_time, Cost budget, int* reached) { \
+     return reachability_kernel(tt, fare, ctx, start_index, start_day, departure_time, \
+                                type, budget, reached); \
+ }
+ 
+ DEFINE_REACHABILITY_SEARCH(reachability_cheapest, CHEAPEST)
+ DEFINE_REACHABILITY_SEARCH(reachability_fastest, FASTEST)
+ DEFINE_REACHABILITY_SEARCH(reachability_optimal, OPTIMAL)
+ 
+ //a budget has to be a finite amount of at least zero
+ bool valid_budget(double budget) {
+     return isfinite(budget) && budget >= 0;
+ }
+ 
+ //runs the reachability query, returns the result as json, NULL if the origin
+ //or the day is unknown or the budget is not valid
+ cJSON* reachability_search(const Timetable* tt, const FareTable* fares, SearchContext* ctx,
+                            const char* start_code, const char* start_day, int departure_time,
+                            RouteType route_type, double budget) {
+     const Cost* fare = snapshot_fares(tt, fares, ECONOMY);
+     int start_index = find_airport_index(tt, start_code);
+     if (start_index < 0) {
+         fprintf(stderr, "Error: Invalid airport code (%s not found)\n", start_code);
+         return NULL;
+     }
+     if (find_day_index(start_day) < 0) {
+         fprintf(stderr, "Error: Invalid day %s\n", start_day);
+         return NULL;
+     }
+     if (!valid_budget(budget)) {
+         fprintf(stderr, "Error: Invalid budget %g\n", budget);
+         return NULL;
+     }
+ 
+     int reached[MAX_AIRPORTS];
+     int num_reached;
+     //a budget past what a Cost holds is no limit at all
+     Cost limit = budget * COST_SCALE >= (double)INFINITY_COST ? INFINITY_COST : cost_from_double(budget);
+     switch (route_type) {
+         case CHEAPEST:
+             num_reached = reachability_cheapest(tt, fare, ctx, start_index, start_day, departure_time, limit, reached);
+             break;
+         case FASTEST:
+             num_reached = reachability_fastest(tt, fare, ctx, start_index, start_day, departure_time, limit, reached);
+             break;
+         default:
+             num_reached = reachability_optimal(tt, fare, ctx, start_index, start_day, departure_time, limit, reached);
+             break;
+     }
+     const Node* nodes = ctx->nodes;
+ 
+     char time_str[MAX_TIME_LENGTH];
+     cJSON* root = cJSON_CreateObject();
+     cJSON_AddStringToObject(root, "origin", start_code);
+     cJSON_AddStringToObject(root, "departure_day", start_day);
+     minutes_to_time(departure_time, time_str);
+     cJSON_AddStringToObject(root, "departure_time", time_str);
+     cJSON_AddStringToObject(root, "metric", budget_metric_names[route_type]);
+     cJSON_AddNumberToObject(root, "budget", budget);
+     cJSON* airports = cJSON_CreateArray();
+ 
+     //the origin itself is not a destination
+     for (int r = 1; r < num_reached; r++) {
+         int a = reached[r];
+         int path[MAX_PATH];
+         int path_size = 0;
+         for (int at = a; at != start_index && path_size < MAX_PATH; at = nodes[at].parent_index) {
+             path[path_size++] = nodes[at].flight_index;
+         }
+ 
+         cJSON* airport = cJSON_CreateObject();
+         cJSON_AddStringToObject(airport, "code", tt->airports[a].code);
+         cJSON_AddStringToObject(airport, "name", tt->airports[a].name);
+         cJSON_AddStringToObject(airport, "arrival_day", day_name(nodes[a].arrival_day));
+         minutes_to_time(nodes[a].arrival_time, time_str);
+         cJSON_AddStringToObject(airport, "arrival_time", time_str);
+         cJSON_AddNumberToObject(airport, "route_cost", cost_to_double(nodes[a].g_cost));
+         cJSON* segments = cJSON_CreateArray();
+         Cost total_cost = 0;
+         int total_duration = 0;
+         //the path was collected from the airport back to the origin
+         for (int k = path_size - 1; k >= 0; k--) {
+             cJSON_AddItemToArray(segments, create_segment_json(tt, fares, path[k]));
+             total_cost += flight_fare(tt, fares, path[k]);
+             total_duration += tt->flights[path[k]].duration;
+         }
+         cJSON_AddNumberToObject(airport, "total_cost", cost_to_double(total_cost));
+         cJSON_AddNumberToObject(airport, "total_duration", total_duration);
+         cJSON_AddItemToObject(airport, "segments", segments);
+         cJSON_AddItemToArray(airports, airport);
+     }
+     cJSON_AddItemToObject(root, "airports", airports);
+     return root;
+ }
+ 
+ /* arrive-by search: the journey that lands at the destination by a given
+ minute of the week and leaves the origin as late as possible
+ it runs backwards from the destination, a dijkstra over the lead of every
+ airport, how long before the deadline the traveller has to take off from
+ it: the destination has a lead of 0, a flight from u into v, taken the
+ last time it lands early enough for the traveller to make the flight out
+ of v with its min_waiting_time, gives u the lead of v plus the time it
+ waits on the ground at v and the flight itself
+ the flights into v come from its arrival list, by landing time, so the
+ ones that land in time are taken from the latest back, the wait only grows
+ along them and the scan stops at the first one that cannot leave later
+ than a journey from the origin already found, and the latest departure
+ comes out of one search, not a forward search for every departure time
+ times are minutes of the week like in the profile search, not the day
+ names of the forward search, either code can be a group of airports
+ returns NULL if one of them is unknown
+*/
+ cJSON* arrive_by_search(const Timetable* tt, const FareTable* fares, SearchContext* ctx,
+                         const char* from, const char* to, int arrive_by) {
+     int origins[MAX_GROUP_AIRPORTS];
+     int destinations[MAX_GROUP_AIRPORTS];
+     int num_origins = find_airport_set(tt, from, origins);
+     int num_destinations = find_airport_set(tt, to, destinations);
+     if (num_origins == 0 || num_destinations == 0) {
+         fprintf(stderr, "Error: Invalid airport codes (%s or %s not found)\n", from, to);
+         return NULL;
+     }
+     arrive_by = (arrive_by % MINUTES_PER_WEEK + MINUTES_PER_WEEK) % MINUTES_PER_WEEK;
+     bool is_origin[MAX_AIRPORTS] = {false};
+     bool is_destination[MAX_AIRPORTS] = {false};
+     for (int o = 0; o < num_origins; o++) {
+         is_origin[origins[o]] = true;
+     }
+     
+     search_context_reset(ctx);
+     Node* nodes = ctx->nodes;
+     for (int d = 0; d < num_destinations; d++) {
+         int index = destinations[d];
+         is_destination[index] = true;
+         search_context_visit(ctx, index);
+         nodes[index].g_cost = nodes[index].f_cost = 0;
+         pq_enqueue(&ctx->open_set, index, 0);
+     }
+     
+     //the lowest lead of an origin found so far, and the origin
+     Cost best_lead = INFINITY_COST;
+     int origin = -1;
+     while (ctx->open_set.size > 0) {
+         int current = pq_dequeue(&ctx->open_set);
+         if (is_origin[current]) {
+             origin = current;
+             break;
+         }
+         ctx->closed_set[current] = true;
+         
+         //the traveller has to be on the ground here this long before the deadline
+         int needed = (int)nodes[current].g_cost + (is_destination[current] ? 0 : tt->airports[current].min_waiting_time);
+         int latest = ((arrive_by - needed) % MINUTES_PER_WEEK + MINUTES_PER_WEEK) % MINUTES_PER_WEEK;
+         //the flights landing at latest or before it, the latest first, and
+         //then the ones of the week before, from the end of the list
+         const DepartureList* incoming = &tt->arrivals[current];
+         int split = departure_index_lower_bound(incoming, latest + 1);
+         for (int n = 0; n < incoming->count; n++) {
+             int k = n < split ? split - 1 - n : incoming->count - 1 - (n - split);
+             int wait = latest - incoming->flights[k].minute_of_week;
+             if (wait < 0) wait += MINUTES_PER_WEEK;
+             if (needed + wait >= best_lead)
+                 break;
+             int i = incoming->flights[k].flight_index;
+             const ScheduledFlight* f = &tt->flights[i];
+             if (!f->available || flight_sold_out(tt, i) || f->from_index < 0)
+                 continue;
+             int previous = f->from_index;
+             search_context_visit(ctx, previous);
+             if (ctx->closed_set[previous])
+                 continue;
+             
+             Cost lead = needed + wait + f->duration;
+             if (lead < nodes[previous].g_cost) {
+                 nodes[previous].g_cost = nodes[previous].f_cost = lead;
+                 //the journey goes on to current with flight i
+                 nodes[previous].parent_index = current;
+                 nodes[previous].flight_index = i;
+                 pq_enqueue(&ctx->open_set, previous, lead);
+                 if (is_origin[previous] && lead < best_lead)
+                     best_lead = lead;
+             }
+         }
+     }
+     
+     char time_str[MAX_TIME_LENGTH];
+     cJSON* root = cJSON_CreateObject();
+     cJSON_AddStringToObject(root, "origin", from);
+     cJSON_AddStringToObject(root, "destination", to);
+     cJSON_AddStringToObject(root, "arrive_by_day", days_of_week[arrive_by / 1440]);
+     minutes_to_time(arrive_by % 1440, time_str);
+     cJSON_AddStringToObject(root, "arrive_by_time", time_str);
+     //an origin that is also a destination has nowhere to fly
+     if (origin < 0 || nodes[origin].flight_index < 0) return root;
+     
+     //the parents lead forward from the origin, the path is in travel order
+     int path[MAX_PATH];
+     int path_size = 0;
+     for (int at = origin; nodes[at].flight_index >= 0 && path_size < MAX_PATH; at = nodes[at].parent_index) {
+         path[path_size++] = nodes[at].flight_index;
+     }
+     const ScheduledFlight* first = &tt->flights[path[0]];
+     const ScheduledFlight* last = &tt->flights[path[path_size - 1]];
+     int arrival = flight_arrival_minute_of_week(last);
+     
+     cJSON* journey = cJSON_CreateObject();
+     cJSON_AddStringToObject(journey, "departure_day", first->day_of_week);
+     minutes_to_time(first->departure_time, time_str);
+     cJSON_AddStringToObject(journey, "departure_time", time_str);
+     cJSON_AddStringToObject(journey, "arrival_day", days_of_week[arrival / 1440]);
+     minutes_to_time(arrival % 1440, time_str);
+     cJSON_AddStringToObject(journey, "arrival_time", time_str);
+     cJSON* segments = cJSON_CreateArray();
+     Cost total_cost = 0;
+     for (int k = 0; k < path_size; k++) {
+         cJSON_AddItemToArray(segments, create_segment_json(tt, fares, path[k]));
+         total_cost += flight_fare(tt, fares, path[k]);
+     }
+     //from the take off at the origin to the landing of the last flight,
+     //which took off the lead of its airport before the deadline
+     int total_duration = (int)(nodes[origin].g_cost - nodes[last->from_index].g_cost) + last->duration;
+     cJSON_AddNumberToObject(journey, "total_cost", cost_to_double(total_cost));
+     cJSON_AddNumberToObject(journey, "total_duration", total_duration);
+     cJSON_AddNumberToObject(journey, "lead_minutes", (double)nodes[origin].g_cost);
+     cJSON_AddItemToObject(journey, "segments", segments);
+     cJSON_AddItemToObject(root, "journey", journey);
+     return root;
+ }
+ 
+ //converts the time string to minutes since midnight
+int time_to_minutes(const char* time_str) {
+    int hours, minutes;
+    if (sscanf(time_str, "%d:%d", &hours, &minutes) != 2) {
+        fprintf(stderr, "Invalid time format: %s\n", time_str);
+        return -1;
+    }
+    return hours * 60 + minutes;
+}
+
+//calculates the time difference between 2 times the start and end time
+int time_difference(int time1, int time2) {
+    //same day
+    if (time2 >= time1) return time2 - time1;
+    //overnight
+    return (24 * 60 - time1) + time2;
+}
+
+//calculates the distance between 2 points using the Haversine formula
+double calculate_distance(double lat1, double lon1, double lat2, double lon2) {
+    //converting from degrees to radians
+    double dLat = (lat2 - lat1) * M_PI / 180.0;
+    double dLon = (lon2 - lon1) * M_PI / 180.0;
     
     //Haversine formula
     double a = sin(dLat/2) * sin(dLat/2) +
@@ -609,271 +4281,1704 @@ double calculate_distance(double lat1, double lon1, double lat2, double lon2) {
     return 6371 * 2 * atan2(sqrt(a), sqrt(1-a));
 }
 
-//the heuristics is another function that is taken in consideration during the
-//calculation of the total cost
-//depending on the route type, different heuristics are used
-double heuristic(int current_index, int goal_index, RouteType route_type) {
-    //calculate straight-line distance
-    double distance = calculate_distance(
-        airports[current_index].lat, airports[current_index].lon,
-        airports[goal_index].lat, airports[goal_index].lon
-    );
-    
-    switch (route_type) {
-        case CHEAPEST: return distance * 0.1;
-        case FASTEST: return distance / 800;
-        case OPTIMAL: return distance * 0.05;
-        default: return distance;
-    }
+//the heuristics is another function that is taken in consideration during the
+//calculation of the total cost
+//depending on the route type, different heuristics are used
+Cost heuristic(const Timetable* tt, int current_index, int goal_index, RouteType route_type) {
+    //calculate straight-line distance
+    double distance = calculate_distance(
+        tt->airports[current_index].lat, tt->airports[current_index].lon,
+        tt->airports[goal_index].lat, tt->airports[goal_index].lon
+    );
+    
+    //in the fixed point of the route costs
+    switch (route_type) {
+        case CHEAPEST: return (Cost)(distance * 0.1 * COST_SCALE);
+        case FASTEST: return (Cost)(distance / 800 * COST_SCALE);
+        case OPTIMAL: return (Cost)(distance * 0.05 * COST_SCALE);
+        default: return (Cost)(distance * COST_SCALE);
+    }
+}
+
+//checks if a connection between flights is possible given arrival and departure times
+bool is_connection_possible(int arrival_time, int next_departure_time,
+                          const char* arrival_day, const char* departure_day,
+                          int min_connection_time) {
+    //if the flights are on the same day, check if there is enought time between them
+    if (strcmp(arrival_day, departure_day) == 0) {
+        return (next_departure_time - arrival_time) >= min_connection_time;
+    }
+    //if on different days, conncection possible
+    return true;
+}
+
+// calculates the waiting time between glights in minutes, handling cases where
+//flights are on the same or on differents days
+int calculate_wait_time(int arrival_time, const char* arrival_day,
+                      int next_departure_time, const char* departure_day) {
+    //if the flights are on the same day, simple time difference
+    if (strcmp(arrival_day, departure_day) == 0) {
+        return next_departure_time - arrival_time;
+    }
+    //if flights are on different days
+    //calculate minutes from arrival to midnight
+    //and add minutes from midnight to next flight
+    return (24 * 60 - arrival_time) + next_departure_time;
+}
+
+//returns the position of a day in days_of_week, or -1 if it is not a day name
+int find_day_index(const char* day) {
+    for (int i = 0; i < 7; i++) {
+        if (strcmp(day, days_of_week[i]) == 0) return i;
+    }
+    return -1;
+}
+
+//day of the week calculator
+//calculates the next time of the week based on the curent day
+void get_next_day(const char* current_day, char* next_day) {
+    //iterate through the days of the week
+    for (int i = 0; i < 6; i++) {
+        if (strcmp(current_day, days_of_week[i]) == 0) {
+            //set the next day
+            strcpy(next_day, days_of_week[i+1]);
+            return;
+        }
+    }
+    //if day not found, default to monday 
+    //or if sunday
+    strcpy(next_day, "monday");
+}
+
+//builds the output in the json form
+//for all 3 route options cheapest, fastest, optimal
+//the path contains the flight indices coresponding to that path
+//the costs are the fares the search used, NULL for the static ones
+//the caller deletes the returned object
+cJSON* build_json_output(const Timetable* tt, const FareTable* fares,
+    int* cheapest_path, int cheapest_path_size,
+    int* fastest_path, int fastest_path_size,
+    int* optimal_path, int optimal_path_size,
+    const char* from, const char* to, const char* day,
+    int departure_time) {
+//creating the root json object
+cJSON* root = cJSON_CreateObject();
+cJSON* journeys = cJSON_CreateObject();
+
+//adding simple information to the top level
+cJSON_AddStringToObject(root, "origin", from);
+cJSON_AddStringToObject(root, "destination", to);
+cJSON_AddStringToObject(root, "departure_day", day);
+
+//format departure time from minutes to string
+char time_str[6];
+minutes_to_time(departure_time, time_str);
+cJSON_AddStringToObject(root, "departure_time", time_str);
+
+//if available, the cheapest journey
+if (cheapest_path_size > 0) {
+cJSON* cheapest_journey = cJSON_CreateObject();
+cJSON* cheapest_segments = cJSON_CreateArray();
+Cost total_cost = 0;
+int total_duration = 0;
+
+//adding each flight node
+for (int i = 0; i < cheapest_path_size; i++) {
+const ScheduledFlight* f = &tt->flights[cheapest_path[i]];
+Cost cost = flight_fare(tt, fares, cheapest_path[i]);
+cJSON* segment = cJSON_CreateObject();
+
+//add node details
+cJSON_AddStringToObject(segment, "from", f->from);
+cJSON_AddStringToObject(segment, "to", f->to);
+cJSON_AddStringToObject(segment, "day", f->day_of_week);
+
+minutes_to_time(f->departure_time, time_str);
+cJSON_AddStringToObject(segment, "departure_time", time_str);
+
+minutes_to_time(f->arrival_time, time_str);
+cJSON_AddStringToObject(segment, "arrival_time", time_str);
+
+cJSON_AddNumberToObject(segment, "duration", f->duration);
+cJSON_AddNumberToObject(segment, "cost", cost_to_double(cost));
+cJSON_AddNumberToObject(segment, "distance", f->distance);
+
+cJSON_AddItemToArray(cheapest_segments, segment);
+
+//calculate the total cost and flight duration
+total_cost += cost;
+total_duration += f->duration;
+}
+
+//add the total cost and flight duration and the nodes
+cJSON_AddNumberToObject(cheapest_journey, "total_cost", cost_to_double(total_cost));
+cJSON_AddNumberToObject(cheapest_journey, "total_duration", total_duration);
+cJSON_AddItemToObject(cheapest_journey, "segments", cheapest_segments);
+cJSON_AddItemToObject(journeys, "cheapest", cheapest_journey);
+}
+
+//if available the fastest journey
+if (fastest_path_size > 0) {
+cJSON* fastest_journey = cJSON_CreateObject();
+cJSON* fastest_segments = cJSON_CreateArray();
+Cost total_cost = 0;
+int total_duration = 0;
+
+//adding each flight node
+for (int i = 0; i < fastest_path_size; i++) {
+const ScheduledFlight* f = &tt->flights[fastest_path[i]];
+Cost cost = flight_fare(tt, fares, fastest_path[i]);
+cJSON* segment = cJSON_CreateObject();
+
+//node information
+cJSON_AddStringToObject(segment, "from", f->from);
+cJSON_AddStringToObject(segment, "to", f->to);
+cJSON_AddStringToObject(segment, "day", f->day_of_week);
+
+minutes_to_time(f->departure_time, time_str);
+cJSON_AddStringToObject(segment, "departure_time", time_str);
+
+minutes_to_time(f->arrival_time, time_str);
+cJSON_AddStringToObject(segment, "arrival_time", time_str);
+
+cJSON_AddNumberToObject(segment, "duration", f->duration);
+cJSON_AddNumberToObject(segment, "cost", cost_to_double(cost));
+cJSON_AddNumberToObject(segment, "distance", f->distance);
+
+cJSON_AddItemToArray(fastest_segments, segment);
+
+total_cost += cost;
+total_duration += f->duration;
+}
+
+cJSON_AddNumberToObject(fastest_journey, "total_cost", cost_to_double(total_cost));
+cJSON_AddNumberToObject(fastest_journey, "total_duration", total_duration);
+cJSON_AddItemToObject(fastest_journey, "segments", fastest_segments);
+cJSON_AddItemToObject(journeys, "fastest", fastest_journey);
+}
+
+//if avialble, the optimal journey
+if (optimal_path_size > 0) {
+cJSON* optimal_journey = cJSON_CreateObject();
+cJSON* optimal_segments = cJSON_CreateArray();
+Cost total_cost = 0;
+int total_duration = 0;
+
+//each flight node
+for (int i = 0; i < optimal_path_size; i++) {
+const ScheduledFlight* f = &tt->flights[optimal_path[i]];
+Cost cost = flight_fare(tt, fares, optimal_path[i]);
+cJSON* segment = cJSON_CreateObject();
+
+//node details
+cJSON_AddStringToObject(segment, "from", f->from);
+cJSON_AddStringToObject(segment, "to", f->to);
+cJSON_AddStringToObject(segment, "day", f->day_of_week);
+
+minutes_to_time(f->departure_time, time_str);
+cJSON_AddStringToObject(segment, "departure_time", time_str);
+
+minutes_to_time(f->arrival_time, time_str);
+cJSON_AddStringToObject(segment, "arrival_time", time_str);
+
+cJSON_AddNumberToObject(segment, "duration", f->duration);
+cJSON_AddNumberToObject(segment, "cost", cost_to_double(cost));
+cJSON_AddNumberToObject(segment, "distance", f->distance);
+
+cJSON_AddItemToArray(optimal_segments, segment);
+
+total_cost += cost;
+total_duration += f->duration;
 }
 
-//checks if a connection between flights is possible given arrival and departure times
-bool is_connection_possible(int arrival_time, int next_departure_time,
-                          const char* arrival_day, const char* departure_day,
-                          int min_connection_time) {
-    //if the flights are on the same day, check if there is enought time between them
-    if (strcmp(arrival_day, departure_day) == 0) {
-        return (next_departure_time - arrival_time) >= min_connection_time;
-    }
-    //if on different days, conncection possible
-    return true;
+cJSON_AddNumberToObject(optimal_journey, "total_cost", cost_to_double(total_cost));
+cJSON_AddNumberToObject(optimal_journey, "total_duration", total_duration);
+cJSON_AddItemToObject(optimal_journey, "segments", optimal_segments);
+cJSON_AddItemToObject(journeys, "optimal", optimal_journey);
 }
 
-// calculates the waiting time between glights in minutes, handling cases where
-//flights are on the same or on differents days
-int calculate_wait_time(int arrival_time, const char* arrival_day,
-                      int next_departure_time, const char* departure_day) {
-    //if the flights are on the same day, simple time difference
-    if (strcmp(arrival_day, departure_day) == 0) {
-        return next_departure_time - arrival_time;
+//add all journeys to the root
+cJSON_AddItemToObject(root, "journeys", journeys);
+return root;
+}
+
+ //flags the answer of build_json_output with how the searches ended: every
+ //journey gets "best_effort", true if a deadline stopped its search before
+ //it was known to be the best, and so does the answer if any search was
+ //stopped, a search stopped before it found a journey leaves its journey out
+ void add_search_status(cJSON* root, const SearchTask* routes) {
+     const char* names[NUM_ROUTE_TYPES] = {"cheapest", "fastest", "optimal"};
+     cJSON* journeys = cJSON_GetObjectItem(root, "journeys");
+     bool best_effort = false;
+     for (int r = 0; r < NUM_ROUTE_TYPES; r++) {
+         cJSON* journey = journeys ? cJSON_GetObjectItem(journeys, names[r]) : NULL;
+         if (journey) cJSON_AddBoolToObject(journey, "best_effort", routes[r].best_effort);
+         best_effort = best_effort || routes[r].best_effort;
+     }
+     cJSON_AddBoolToObject(root, "best_effort", best_effort);
+ }
+
+ //runs the three route searches of a query on pool, or on ctx without a pool,
+ //and returns the answer as an unformatted json string, NULL on errors
+ char* route_search_json(WorkerPool* pool, SearchContext* ctx, const Timetable* tt, const FareTable* fares,
+                         const char* from, const char* to, const char* day, int departure_time,
+                         const SearchConstraints* constraints, long long deadline_us) {
+     SearchTask routes[NUM_ROUTE_TYPES];
+     init_route_tasks(routes, tt, fares, from, to, day, departure_time, constraints, deadline_us);
+     run_search_batch(pool, ctx, routes, NUM_ROUTE_TYPES);
+
+     long long started = monotonic_ns();
+     cJSON* root = build_json_output(tt, fares,
+                           routes[CHEAPEST].path, routes[CHEAPEST].path_size,
+                           routes[FASTEST].path, routes[FASTEST].path_size,
+                           routes[OPTIMAL].path, routes[OPTIMAL].path_size,
+                           from, to, day, departure_time);
+     if (!root) return NULL;
+     add_search_status(root, routes);
+     char* json_str = cJSON_PrintUnformatted(root);
+     cJSON_Delete(root);
+     phase_record(PHASE_SERIALIZE, started);
+     return json_str;
+ }
+ 
+ //the copy of a shared answer a caller gets to keep
+ char* copy_search_result(const char* result) {
+     if (!result) return NULL;
+     char* copy = (char*)malloc(strlen(result) + 1);
+     if (copy) strcpy(copy, result);
+     return copy;
+ }
+ 
+ /* route_search_json, shared with the identical queries running at the same time
+ constraints_text is the json the constraints were read from, NULL for none, and
+ deadline_ms the budget they were given, queries with other budgets do not mix
+ a follower gets the leader's answer, found within the leader's deadline,
+ which is never later than its own as it came in later
+ a query too long for the key searches on its own
+ the text fields of the key are prefixed with their length, so no two
+ queries make the same key by moving a space from one field to the next
+*/
+ char* shared_route_search(WorkerPool* pool, SearchContext* ctx, const Timetable* tt, const FareTable* fares,
+                           const char* from, const char* to, const char* day, int departure_time,
+                           const char* constraints_text, const SearchConstraints* constraints,
+                           int deadline_ms, long long deadline_us) {
+     char key[MAX_SEARCH_KEY];
+     const char* limits = constraints_text ? constraints_text : "";
+     int key_len = snprintf(key, sizeof(key), "%p %p %zu:%s %zu:%s %zu:%s %d %d %zu:%s",
+                            (const void*)tt, (const void*)fares, strlen(from), from, strlen(to), to,
+                            strlen(day), day, departure_time, deadline_ms, strlen(limits), limits);
+     if (key_len < 0 || key_len >= (int)sizeof(key)) {
+         return route_search_json(pool, ctx, tt, fares, from, to, day, departure_time, constraints, deadline_us);
+     }
+
+     SearchFlights* flights = &route_flights;
+     pthread_mutex_lock(&flights->lock);
+     InFlightSearch* flight = flights->head;
+     while (flight && strcmp(flight->key, key) != 0) flight = flight->next;
+     if (flight) {
+         //follower: wait for the leader, the last one out frees the entry
+         flight->waiters++;
+         flights->shared++;
+         while (!flight->done) {
+             pthread_cond_wait(&flights->finished, &flights->lock);
+         }
+         char* json_str;
+         if (--flight->waiters == 0) {
+             json_str = flight->result;
+             free(flight);
+         } else {
+             json_str = copy_search_result(flight->result);
+         }
+         pthread_mutex_unlock(&flights->lock);
+         return json_str;
+     }
+
+     flight = (InFlightSearch*)calloc(1, sizeof(InFlightSearch));
+     if (flight) {
+         memcpy(flight->key, key, key_len + 1);
+         flight->next = flights->head;
+         flights->head = flight;
+     }
+     flights->searches++;
+     pthread_mutex_unlock(&flights->lock);
+
+     char* json_str = route_search_json(pool, ctx, tt, fares, from, to, day, departure_time, constraints, deadline_us);
+     if (!flight) return json_str;
+
+     //leader: take the entry out so later queries search again, and hand the
+     //followers a copy of the answer
+     pthread_mutex_lock(&flights->lock);
+     InFlightSearch** link = &flights->head;
+     while (*link != flight) link = &(*link)->next;
+     *link = flight->next;
+     if (flight->waiters > 0) {
+         flight->result = copy_search_result(json_str);
+         flight->done = true;
+         pthread_cond_broadcast(&flights->finished);
+     } else {
+         free(flight);
+     }
+     pthread_mutex_unlock(&flights->lock);
+     return json_str;
+ }
+
+//write output in the json form to a file
+bool write_json_output(const Timetable* tt, const char* filename, 
+    int* cheapest_path, int cheapest_path_size,
+    int* fastest_path, int fastest_path_size,
+    int* optimal_path, int optimal_path_size,
+    const char* from, const char* to, const char* day,
+    int departure_time) {
+long long started = monotonic_ns();
+cJSON* root = build_json_output(tt, NULL,
+    cheapest_path, cheapest_path_size,
+    fastest_path, fastest_path_size,
+    optimal_path, optimal_path_size,
+    from, to, day, departure_time);
+
+//writing to the file in the json format
+char* json_str = cJSON_Print(root);
+FILE* fp = fopen(filename, "w");
+if (!fp) {
+    //handles the file oppening error
+cJSON_Delete(root);
+free(json_str);
+return false;
+}
+
+fputs(json_str, fp);
+fclose(fp);
+
+//frees up the allocated memory
+cJSON_Delete(root);
+free(json_str);
+phase_record(PHASE_SERIALIZE, started);
+return true;
+}
+
+//function which finds the airport index
+//it searches an airport in tha array by its code
+int find_airport_index(const Timetable* tt, const char* code) {
+    //linear search throught the airports array
+    for (int i = 0; i < tt->num_airports; i++) {
+        if (strcmp(tt->airports[i].code, code) == 0) {
+            return i;
+        }
     }
-    //if flights are on different days
-    //calculate minutes from arrival to midnight
-    //and add minutes from midnight to next flight
-    return (24 * 60 - arrival_time) + next_departure_time;
+    //error
+    fprintf(stderr, "Airport not found: %s\n", code);
+    return -1;  
 }
 
-//day of the week calculator
-//calculates the next time of the week based on the curent day
-void get_next_day(const char* current_day, char* next_day) {
-    //iterate through the days of the week
-    for (int i = 0; i < 6; i++) {
-        if (strcmp(current_day, days_of_week[i]) == 0) {
-            //set the next day
-            strcpy(next_day, days_of_week[i+1]);
-            return;
+//resolves a code to the airports it stands for: the members of the group
+//with that code, or else the airport itself, returns how many there are
+int find_airport_set(const Timetable* tt, const char* code, int* airports) {
+    for (int g = 0; g < tt->num_groups; g++) {
+        if (strcmp(tt->groups[g].code, code) == 0) {
+            memcpy(airports, tt->groups[g].airports, tt->groups[g].count * sizeof(int));
+            return tt->groups[g].count;
         }
     }
-    //if day not found, default to monday 
-    //or if sunday
-    strcpy(next_day, "monday");
+    airports[0] = find_airport_index(tt, code);
+    return airports[0] < 0 ? 0 : 1;
+}
+
+//calculates the cost of a flight journey based on the route type
+//the different route types use other criteria to detrmine the best path
+Cost calculate_route_cost(RouteType route_type, Cost cost, int duration, double distance) {
+    switch (route_type) {
+        case CHEAPEST:
+        //just about the money
+            return cost;  
+            
+        case FASTEST:
+        //time efficiency
+            return (Cost)duration * COST_SCALE; 
+            
+        case OPTIMAL:
+        //balanced
+        //(0.1 cost units per minute, ten cents)
+            return cost + (Cost)duration * (COST_SCALE / 10);
+            
+        default:
+            fprintf(stderr, "Invalid route type\n");
+            return cost;
+    }
 }
 
-//write output in the json form
-//for all 3 route options cheapest, fastest, optimal
-//the path contains the flight indices coresponding to that path
-bool write_json_output(const char* filename, 
-    int* cheapest_path, int cheapest_path_size,
-    int* fastest_path, int fastest_path_size,
-    int* optimal_path, int optimal_path_size,
-    const char* from, const char* to, const char* day,
-    int departure_time) {
-//creating the root json object
-cJSON* root = cJSON_CreateObject();
-cJSON* journeys = cJSON_CreateObject();
+#ifdef __linux__
+/* http front end, serves the same /api/data contract as app.py
+ one thread runs an epoll loop over the listening socket and the connections,
+ it reads and parses the requests and writes the responses, the searches run
+ on a fixed set of http workers that each own a search context
+ a worker hands a finished connection back through the completed list and
+ wakes the loop with an eventfd, a connection is owned by the loop or by
+ one worker at a time so it needs no lock of its own
+ connections are kept alive, a pipelined request waits in the buffer until
+ the response to the one before it has been sent
+*/
+ #define MAX_REQUEST_SIZE 8192
+ #define MAX_EVENTS 256
+ #define DEFAULT_PORT 5000
+ #define DEFAULT_DEADLINE_MS 250
+
+ typedef struct HttpConnection {
+     int fd;
+     char in[MAX_REQUEST_SIZE];
+     int in_len;
+     int request_len;      //header and body length of the request being served
+     char* out;
+     int out_len;
+     int out_sent;
+     bool keep_alive;
+     bool busy;            //at a worker, the loop leaves it alone
+     bool local;           //the peer is on this host, it may read the stats
+     bool closing;         //peer gone while busy, freed when the worker is done
+     struct HttpConnection* next;
+     struct HttpConnection* prev_open;  //the list of open connections, only
+     struct HttpConnection* next_open;  //the loop thread touches it
+ } HttpConnection;
+
+ typedef struct {
+     int listen_fd;
+     int epoll_fd;
+     int wake_fd;          //eventfd, written by the workers
+     pthread_mutex_t lock;
+     pthread_cond_t has_work;
+     HttpConnection* queue_head;  //requests waiting for a worker
+     HttpConnection* queue_tail;
+     HttpConnection* completed;   //responses waiting to be sent
+     HttpConnection* open;        //every connection, the ones left are closed at shutdown
+     BookingJournal* journal;     //NULL if bookings are not taken
+     const char* timetable_file;  //loaded again by POST /api/reload
+     bool stopping;
+     int num_workers;
+     pthread_t* workers;
+ } HttpServer;
+
+ volatile sig_atomic_t server_stop_requested = 0;
+ volatile sig_atomic_t stats_dump_requested = 0;
+
+ void handle_stop_signal(int sig) {
+     (void)sig;
+     server_stop_requested = 1;
+ }
+
+ //SIGUSR1, the loop prints the phase latencies to stderr
+ void handle_stats_signal(int sig) {
+     (void)sig;
+     stats_dump_requested = 1;
+ }
+
+//finds a header value in the header block, case insensitive name
+//copies at most size-1 characters, returns false if the header is missing
+ bool http_header_value(const char* headers, const char* name, char* value, int size) {
+     int name_len = (int)strlen(name);
+     const char* line = strstr(headers, "\r\n");
+     while (line && line[2] != '\r') {
+         line += 2;
+         if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+             const char* v = line + name_len + 1;
+             while (*v == ' ' || *v == '\t') v++;
+             int n = 0;
+             while (v[n] && v[n] != '\r' && n < size - 1) {
+                 value[n] = v[n];
+                 n++;
+             }
+             value[n] = '\0';
+             return true;
+         }
+         line = strstr(line, "\r\n");
+     }
+     return false;
+ }
+
+//builds the full response in conn->out, the body is copied
+ void http_set_response(HttpConnection* conn, int status, const char* reason, const char* body) {
+     int body_len = body ? (int)strlen(body) : 0;
+     int size = body_len + 512;
+     free(conn->out);
+     conn->out = (char*)malloc(size);
+     conn->out_sent = 0;
+     if (!conn->out) {
+         conn->out_len = 0;
+         conn->keep_alive = false;
+         return;
+     }
+     conn->out_len = snprintf(conn->out, size,
+         "HTTP/1.1 %d %s\r\n"
+         "Content-Type: application/json\r\n"
+         "Content-Length: %d\r\n"
+         "Access-Control-Allow-Origin: http://localhost:5174\r\n"
+         "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
+         "Access-Control-Allow-Headers: Content-Type\r\n"
+         "Connection: %s\r\n"
+         "\r\n",
+         status, reason, body_len, conn->keep_alive ? "keep-alive" : "close");
+     if (body_len > 0) {
+         memcpy(conn->out + conn->out_len, body, body_len);
+         conn->out_len += body_len;
+     }
+ }
+
+ void http_set_error(HttpConnection* conn, int status, const char* reason, const char* message) {
+     cJSON* root = cJSON_CreateObject();
+     cJSON_AddStringToObject(root, "error", message);
+     char* body = cJSON_PrintUnformatted(root);
+     http_set_response(conn, status, reason, body);
+     free(body);
+     cJSON_Delete(root);
+ }
+
+//parses the json body, which is followed by the next pipelined request if any
+ cJSON* http_parse_body(char* body, int body_len) {
+     char saved = body[body_len];
+     body[body_len] = '\0';
+     cJSON* request = cJSON_Parse(body);
+     body[body_len] = saved;
+     return request;
+ }
+ 
+//runs the query in the body of a POST /api/data on the current timetable
+//an optional "constraints" object limits the journeys, see parse_search_constraints
+//the searches answer within "deadline_ms" of the request being taken up,
+//DEFAULT_DEADLINE_MS if it is left out and without a limit if it is 0
+ //the parsed request, NULL if it is not json, is released by the caller,
+ //which reports the allocations of the query however it ends
+ void http_search_request(HttpConnection* conn, cJSON* request, SearchContext* ctx,
+                          long long started, long long phase_start) {
+     cJSON* source = request ? cJSON_GetObjectItem(request, "source") : NULL;
+     cJSON* destination = request ? cJSON_GetObjectItem(request, "destination") : NULL;
+     cJSON* day = request ? cJSON_GetObjectItem(request, "day") : NULL;
+     cJSON* departure = request ? cJSON_GetObjectItem(request, "departure_time") : NULL;
+     if (!is_json_string(source) || !is_json_string(destination) || !is_json_string(day) ||
+         !departure || !(is_json_string(departure) || (departure->type & 0xFF) == cJSON_Number)) {
+         http_set_error(conn, 400, "Bad Request", "Missing one or more required fields");
+         return;
+     }
+     //read like the departure_time argument of main
+     int departure_time = is_json_string(departure) ? atoi(departure->valuestring) : departure->valueint;
+     cJSON* deadline = cJSON_GetObjectItem(request, "deadline_ms");
+     int deadline_ms = deadline && (deadline->type & 0xFF) == cJSON_Number ? deadline->valueint : DEFAULT_DEADLINE_MS;
+     phase_record(PHASE_PARSE, phase_start);
+
+     phase_start = monotonic_ns();
+     Timetable* tt = timetable_acquire();
+     if (!tt || !ctx) {
+         http_set_error(conn, 503, "Service Unavailable", "No timetable loaded");
+         timetable_release(tt);
+         return;
+     }
+     FareTable* fares = fare_table_acquire();
+     phase_record(PHASE_TIMETABLE, phase_start);
+     //the airports to avoid are looked up in the snapshot the search runs on
+     cJSON* limits = cJSON_GetObjectItem(request, "constraints");
+     SearchConstraints constraints;
+     char error[MAX_ERROR_LENGTH];
+     if (limits && !parse_search_constraints(tt, limits, &constraints, error)) {
+         http_set_error(conn, 400, "Bad Request", error);
+         fare_table_release(fares);
+         timetable_release(tt);
+         return;
+     }
+     //identical queries in flight on the same snapshots share one search
+     char* limits_text = limits ? cJSON_PrintUnformatted(limits) : NULL;
+     char* json_str = shared_route_search(NULL, ctx, tt, fares, source->valuestring, destination->valuestring,
+                                          day->valuestring, departure_time, limits_text,
+                                          limits ? &constraints : NULL, deadline_ms,
+                                          deadline_ms > 0 ? started + deadline_ms * 1000LL : 0);
+     if (json_str) http_set_response(conn, 200, "OK", json_str);
+     else http_set_error(conn, 500, "Internal Server Error", "Search failed");
+     free(json_str);
+     free(limits_text);
+     fare_table_release(fares);
+     timetable_release(tt);
+ }
+ 
+ void http_handle_search(HttpConnection* conn, char* body, int body_len, SearchContext* ctx) {
+     long long started = monotonic_us();
+     long long phase_start = monotonic_ns();
+ #ifdef ALLOC_ACCOUNTING
+     //the searches run on this worker, so its own tally is the query's
+     AllocTally allocs;
+     alloc_tally(&allocs, true);
+ #endif
+     cJSON* request = http_parse_body(body, body_len);
+     http_search_request(conn, request, ctx, started, phase_start);
+ #ifdef ALLOC_ACCOUNTING
+     //a rejected query is reported too, with what it has of the fields
+     cJSON* fields[3] = {NULL, NULL, NULL};
+     const char* names[3] = {"source", "destination", "day"};
+     for (int f = 0; f < 3; f++) {
+         cJSON* field = request ? cJSON_GetObjectItem(request, names[f]) : NULL;
+         if (is_json_string(field)) fields[f] = field;
+     }
+     cJSON* departure = request ? cJSON_GetObjectItem(request, "departure_time") : NULL;
+     char query[MAX_SEARCH_KEY];
+     snprintf(query, sizeof(query), "%s-%s %s %d", fields[0] ? fields[0]->valuestring : "?",
+              fields[1] ? fields[1]->valuestring : "?", fields[2] ? fields[2]->valuestring : "?",
+              is_json_string(departure) ? atoi(departure->valuestring) : departure ? departure->valueint : 0);
+     alloc_report("query", query, &allocs, true);
+ #endif
+     cJSON_Delete(request);
+ }
+
+//the journeys over a departure window, the body of POST /api/profile is the one
+//of /api/data plus "window", its length in minutes, a week if it is left out
+ void http_handle_profile(HttpConnection* conn, char* body, int body_len) {
+     cJSON* request = http_parse_body(body, body_len);
+     cJSON* source = request ? cJSON_GetObjectItem(request, "source") : NULL;
+     cJSON* destination = request ? cJSON_GetObjectItem(request, "destination") : NULL;
+     cJSON* day = request ? cJSON_GetObjectItem(request, "day") : NULL;
+     cJSON* departure = request ? cJSON_GetObjectItem(request, "departure_time") : NULL;
+     cJSON* window = request ? cJSON_GetObjectItem(request, "window") : NULL;
+     int day_index = is_json_string(day) ? find_day_index(day->valuestring) : -1;
+     if (!is_json_string(source) || !is_json_string(destination) || day_index < 0 ||
+         !departure || !(is_json_string(departure) || (departure->type & 0xFF) == cJSON_Number)) {
+         http_set_error(conn, 400, "Bad Request", "Missing one or more required fields");
+         cJSON_Delete(request);
+         return;
+     }
+     if (window && (window->type & 0xFF) != cJSON_Number) {
+         http_set_error(conn, 400, "Bad Request", "The window must be a number of minutes");
+         cJSON_Delete(request);
+         return;
+     }
+     int departure_time = is_json_string(departure) ? atoi(departure->valuestring) : departure->valueint;
+     
+     Timetable* tt = timetable_acquire();
+     if (!tt) {
+         http_set_error(conn, 503, "Service Unavailable", "No timetable loaded");
+         cJSON_Delete(request);
+         return;
+     }
+     FareTable* fares = fare_table_acquire();
+     cJSON* root = profile_search(tt, fares, source->valuestring, destination->valuestring,
+                                  day_index * 1440 + departure_time, window ? window->valueint : MINUTES_PER_WEEK);
+     if (root) {
+         char* json_str = cJSON_PrintUnformatted(root);
+         http_set_response(conn, 200, "OK", json_str);
+         free(json_str);
+         cJSON_Delete(root);
+     } else {
+         http_set_error(conn, 400, "Bad Request", "Profile search failed");
+     }
+     fare_table_release(fares);
+     timetable_release(tt);
+     cJSON_Delete(request);
+ }
+ 
+//the latest journey that arrives in time, the body of POST /api/arrive_by is
+//{"source": "NYC", "destination": "LON", "day": "tuesday", "arrival_time": 540}
+ void http_handle_arrive_by(HttpConnection* conn, char* body, int body_len, SearchContext* ctx) {
+     cJSON* request = http_parse_body(body, body_len);
+     cJSON* source = request ? cJSON_GetObjectItem(request, "source") : NULL;
+     cJSON* destination = request ? cJSON_GetObjectItem(request, "destination") : NULL;
+     cJSON* day = request ? cJSON_GetObjectItem(request, "day") : NULL;
+     cJSON* arrival = request ? cJSON_GetObjectItem(request, "arrival_time") : NULL;
+     int day_index = is_json_string(day) ? find_day_index(day->valuestring) : -1;
+     if (!is_json_string(source) || !is_json_string(destination) || day_index < 0 ||
+         !arrival || !(is_json_string(arrival) || (arrival->type & 0xFF) == cJSON_Number)) {
+         http_set_error(conn, 400, "Bad Request", "Missing one or more required fields");
+         cJSON_Delete(request);
+         return;
+     }
+     int arrival_time = is_json_string(arrival) ? atoi(arrival->valuestring) : arrival->valueint;
+
+     Timetable* tt = timetable_acquire();
+     if (!tt || !ctx) {
+         http_set_error(conn, 503, "Service Unavailable", "No timetable loaded");
+         timetable_release(tt);
+         cJSON_Delete(request);
+         return;
+     }
+     FareTable* fares = fare_table_acquire();
+     cJSON* root = arrive_by_search(tt, fares, ctx, source->valuestring, destination->valuestring,
+                                    day_index * 1440 + arrival_time);
+     if (root) {
+         char* json_str = cJSON_PrintUnformatted(root);
+         http_set_response(conn, 200, "OK", json_str);
+         free(json_str);
+         cJSON_Delete(root);
+     } else {
+         http_set_error(conn, 400, "Bad Request", "Arrive-by search failed");
+     }
+     fare_table_release(fares);
+     timetable_release(tt);
+     cJSON_Delete(request);
+ }
+
+//the airports reachable within a budget, the body of POST /api/reach is
+//{"source": "NYC", "day": "monday", "departure_time": 480, "metric": "cost", "budget": 500}
+//metric is one of cost, duration and optimal, cost if it is left out
+ void http_handle_reach(HttpConnection* conn, char* body, int body_len, SearchContext* ctx) {
+     cJSON* request = http_parse_body(body, body_len);
+     cJSON* source = request ? cJSON_GetObjectItem(request, "source") : NULL;
+     cJSON* day = request ? cJSON_GetObjectItem(request, "day") : NULL;
+     cJSON* departure = request ? cJSON_GetObjectItem(request, "departure_time") : NULL;
+     cJSON* metric = request ? cJSON_GetObjectItem(request, "metric") : NULL;
+     cJSON* budget = request ? cJSON_GetObjectItem(request, "budget") : NULL;
+     int route_type = is_json_string(metric) ? find_budget_metric(metric->valuestring) : CHEAPEST;
+     if (!is_json_string(source) || !is_json_string(day) || find_day_index(day->valuestring) < 0 ||
+         !departure || !(is_json_string(departure) || (departure->type & 0xFF) == cJSON_Number) ||
+         !budget || (budget->type & 0xFF) != cJSON_Number || !valid_budget(budget->valuedouble) ||
+         route_type < 0) {
+         http_set_error(conn, 400, "Bad Request", "Missing one or more required fields");
+         cJSON_Delete(request);
+         return;
+     }
+     int departure_time = is_json_string(departure) ? atoi(departure->valuestring) : departure->valueint;
+
+     Timetable* tt = timetable_acquire();
+     if (!tt || !ctx) {
+         http_set_error(conn, 503, "Service Unavailable", "No timetable loaded");
+         timetable_release(tt);
+         cJSON_Delete(request);
+         return;
+     }
+     FareTable* fares = fare_table_acquire();
+     cJSON* root = reachability_search(tt, fares, ctx, source->valuestring, day->valuestring, departure_time,
+                                       (RouteType)route_type, budget->valuedouble);
+     if (root) {
+         char* json_str = cJSON_PrintUnformatted(root);
+         http_set_response(conn, 200, "OK", json_str);
+         free(json_str);
+         cJSON_Delete(root);
+     } else {
+         http_set_error(conn, 400, "Bad Request", "Reachability search failed");
+     }
+     fare_table_release(fares);
+     timetable_release(tt);
+     cJSON_Delete(request);
+ }
+ 
+/* books seats, the body of POST /api/book is
+   {"cabin": "economy", "seats": 1, "segments": [{"from": "NYC", "to": "LON",
+    "day": "tuesday", "departure_time": "10:30"}, ...]}
+ the segments are the ones of a journey returned by /api/data, cabin and
+ seats are optional, the answer comes once the journal has the booking on disk
+ and is {"booked": true, "booking": "<id>", "cabin": "economy", "price": 0.0},
+ the id the seats are cancelled by and the price of all the seats in the cabin
+*/
+ void http_handle_booking(HttpConnection* conn, char* body, int body_len, BookingJournal* journal) {
+     if (!journal) {
+         http_set_error(conn, 503, "Service Unavailable", "Bookings are not enabled");
+         return;
+     }
+     cJSON* request = http_parse_body(body, body_len);
+     cJSON* cabin_item = request ? cJSON_GetObjectItem(request, "cabin") : NULL;
+     cJSON* seats_item = request ? cJSON_GetObjectItem(request, "seats") : NULL;
+     cJSON* segments = request ? cJSON_GetObjectItem(request, "segments") : NULL;
+     int cabin = is_json_string(cabin_item) ? find_cabin_index(cabin_item->valuestring) : ECONOMY;
+     int seats = seats_item ? seats_item->valueint : 1;
+     int count = segments ? cJSON_GetArraySize(segments) : 0;
+     if (seats_item && (seats_item->type & 0xFF) != cJSON_Number) seats = 0;
+     if (cabin < 0 || seats <= 0 || count <= 0 || count > MAX_PATH) {
+         http_set_error(conn, 400, "Bad Request", "Missing one or more required fields");
+         cJSON_Delete(request);
+         return;
+     }
+     
+     Timetable* tt = timetable_acquire_booking();
+     if (!tt) {
+         http_set_error(conn, 503, "Service Unavailable", "No timetable loaded");
+         cJSON_Delete(request);
+         return;
+     }
+     int flights[MAX_PATH];
+     for (int i = 0; i < count; i++) {
+         cJSON* segment = cJSON_GetArrayItem(segments, i);
+         cJSON* from = cJSON_GetObjectItem(segment, "from");
+         cJSON* to = cJSON_GetObjectItem(segment, "to");
+         cJSON* day = cJSON_GetObjectItem(segment, "day");
+         cJSON* departure = cJSON_GetObjectItem(segment, "departure_time");
+         flights[i] = (is_json_string(from) && is_json_string(to) && is_json_string(day) && is_json_string(departure)) ?
+             find_flight_by_key(tt, from->valuestring, to->valuestring, day->valuestring, departure->valuestring) : -1;
+         if (flights[i] < 0) {
+             http_set_error(conn, 400, "Bad Request", "Unknown flight in segments");
+             timetable_release_booking(tt);
+             cJSON_Delete(request);
+             return;
+         }
+         //no flight can ever take more seats than its cabin has
+         if (seats > tt->flights[flights[i]].seats[cabin]) {
+             http_set_error(conn, 400, "Bad Request", "More seats than the cabin has");
+             timetable_release_booking(tt);
+             cJSON_Delete(request);
+             return;
+         }
+     }
+     
+     char booking_id[BOOKING_ID_LENGTH];
+     BookingResult result = book_seats(journal, tt, flights, count, (CabinClass)cabin, seats, booking_id);
+     if (result == BOOKING_DONE) {
+         //priced at the cabin fares current when it was booked
+         FareTable* fares = fare_table_acquire();
+         Cost price = 0;
+         for (int i = 0; i < count; i++) price += cabin_fare(tt, fares, flights[i], (CabinClass)cabin);
+         fare_table_release(fares);
+         char response[BOOKING_ID_LENGTH + 128];
+         snprintf(response, sizeof(response), "{\"booked\":true,\"booking\":\"%s\",\"cabin\":\"%s\",\"price\":%.2f}",
+                  booking_id, cabin_names[cabin], cost_to_double(price * seats));
+         http_set_response(conn, 200, "OK", response);
+     } else if (result == BOOKING_FAILED) {
+         http_set_error(conn, 500, "Internal Server Error", "Could not record the booking");
+     } else {
+         http_set_error(conn, 409, "Conflict", "Not enough seats");
+     }
+     timetable_release_booking(tt);
+     cJSON_Delete(request);
+ }
+
+//cancels seats of a booking, the body of POST /api/cancel is
+//{"booking": "<id>", "seats": 1}, the id /api/book returned, all the seats
+//the booking still holds if seats is left out
+ void http_handle_cancel(HttpConnection* conn, char* body, int body_len, BookingJournal* journal) {
+     if (!journal) {
+         http_set_error(conn, 503, "Service Unavailable", "Bookings are not enabled");
+         return;
+     }
+     cJSON* request = http_parse_body(body, body_len);
+     cJSON* booking = request ? cJSON_GetObjectItem(request, "booking") : NULL;
+     cJSON* seats_item = request ? cJSON_GetObjectItem(request, "seats") : NULL;
+     int seats = seats_item ? seats_item->valueint : 0;
+     if (seats_item && (seats_item->type & 0xFF) != cJSON_Number) seats = -1;
+     if (!is_json_string(booking) || seats < 0 || (seats_item && seats == 0)) {
+         http_set_error(conn, 400, "Bad Request", "Missing one or more required fields");
+         cJSON_Delete(request);
+         return;
+     }
+     
+     Timetable* tt = timetable_acquire_booking();
+     if (!tt) {
+         http_set_error(conn, 503, "Service Unavailable", "No timetable loaded");
+         cJSON_Delete(request);
+         return;
+     }
+     BookingResult result = cancel_seats(journal, tt, booking->valuestring, seats);
+     if (result == BOOKING_DONE) {
+         http_set_response(conn, 200, "OK", "{\"cancelled\":true}");
+     } else if (result == BOOKING_UNKNOWN) {
+         http_set_error(conn, 404, "Not Found", "Unknown booking");
+     } else if (result == BOOKING_FAILED) {
+         http_set_error(conn, 500, "Internal Server Error", "Could not record the cancellation");
+     } else {
+         http_set_error(conn, 409, "Conflict", "The booking does not hold that many seats");
+     }
+     timetable_release_booking(tt);
+     cJSON_Delete(request);
+ }
+ 
+//GET /api/stats, the phase latencies, see phase_stats_json, and GET /api/trace,
+//the recent phases as a Chrome trace, only for clients on this host
+ void http_handle_stats(HttpConnection* conn, bool trace) {
+     if (!conn->local) {
+         http_set_error(conn, 403, "Forbidden", "Only served to local clients");
+         return;
+     }
+     char* json_str;
+     if (trace) {
+         json_str = trace_json();
+     } else {
+         cJSON* root = phase_stats_json();
+         json_str = cJSON_PrintUnformatted(root);
+         cJSON_Delete(root);
+     }
+     if (json_str) http_set_response(conn, 200, "OK", json_str);
+     else http_set_error(conn, 500, "Internal Server Error", "Memory allocation failed");
+     free(json_str);
+ }
+ 
+//POST /api/reload, loads the timetable file again and publishes it, the seats
+//sold carry over to the flights it still has, only for clients on this host
+//searches running meanwhile finish on the timetable they started with
+ void http_handle_reload(HttpConnection* conn, const char* timetable_file) {
+     if (!conn->local) {
+         http_set_error(conn, 403, "Forbidden", "Only served to local clients");
+         return;
+     }
+     pthread_mutex_lock(&timetable_update_lock);
+     Timetable* loaded = parse_json_input(timetable_file);
+     if (!loaded) {
+         pthread_mutex_unlock(&timetable_update_lock);
+         http_set_error(conn, 500, "Internal Server Error", "Could not load the timetable");
+         return;
+     }
+     char response[128];
+     snprintf(response, sizeof(response), "{\"airports\":%d,\"flights\":%d}",
+              loaded->num_airports, loaded->num_flights);
+     timetable_publish(loaded);
+     pthread_mutex_unlock(&timetable_update_lock);
+     printf("Reloaded %s\n", timetable_file);
+     http_set_response(conn, 200, "OK", response);
+ }
+
+//POST /api/delta, {"file": "changes.json"}, applies a delta file, see
+//apply_delta_file, to the published timetable and publishes the result,
+//the seats sold stay with the flights, only for clients on this host
+ void http_handle_delta(HttpConnection* conn, char* body, int body_len) {
+     if (!conn->local) {
+         http_set_error(conn, 403, "Forbidden", "Only served to local clients");
+         return;
+     }
+     cJSON* request = http_parse_body(body, body_len);
+     cJSON* file = request ? cJSON_GetObjectItem(request, "file") : NULL;
+     if (!is_json_string(file)) {
+         http_set_error(conn, 400, "Bad Request", "Missing one or more required fields");
+         cJSON_Delete(request);
+         return;
+     }
+     pthread_mutex_lock(&timetable_update_lock);
+     Timetable* base = timetable_acquire();
+     Timetable* updated = base ? apply_timetable_delta(base, file->valuestring) : NULL;
+     timetable_release(base);
+     if (!updated) {
+         pthread_mutex_unlock(&timetable_update_lock);
+         http_set_error(conn, 400, "Bad Request", "Could not apply the delta");
+         cJSON_Delete(request);
+         return;
+     }
+     char response[128];
+     snprintf(response, sizeof(response), "{\"airports\":%d,\"flights\":%d}",
+              updated->num_airports, updated->num_flights);
+     timetable_publish(updated);
+     pthread_mutex_unlock(&timetable_update_lock);
+     printf("Applied delta %s\n", file->valuestring);
+     http_set_response(conn, 200, "OK", response);
+     cJSON_Delete(request);
+ }
+
+//answers the request at the start of conn->in
+ void http_handle_request(HttpConnection* conn, SearchContext* ctx, BookingJournal* journal,
+                          const char* timetable_file) {
+     char method[8], path[256], version[16];
+     if (sscanf(conn->in, "%7s %255s %15s", method, path, version) != 3) {
+         conn->keep_alive = false;
+         http_set_error(conn, 400, "Bad Request", "Malformed request line");
+         return;
+     }
+     char* query = strchr(path, '?');
+     if (query) *query = '\0';
+     char* body = strstr(conn->in, "\r\n\r\n") + 4;
+     int body_len = conn->request_len - (int)(body - conn->in);
 
-//adding simple information to the top level
-cJSON_AddStringToObject(root, "origin", from);
-cJSON_AddStringToObject(root, "destination", to);
-cJSON_AddStringToObject(root, "departure_day", day);
+     bool booking = strcmp(path, "/api/book") == 0 || strcmp(path, "/api/cancel") == 0;
+     bool profile = strcmp(path, "/api/profile") == 0;
+     bool reach = strcmp(path, "/api/reach") == 0;
+     bool arrive_by = strcmp(path, "/api/arrive_by") == 0;
+     bool stats = strcmp(path, "/api/stats") == 0 || strcmp(path, "/api/trace") == 0;
+     bool reload = strcmp(path, "/api/reload") == 0;
+     bool delta = strcmp(path, "/api/delta") == 0;
+     if (strcmp(path, "/api/data") != 0 && !booking && !profile && !reach && !arrive_by && !stats &&
+         !reload && !delta) {
+         http_set_error(conn, 404, "Not Found", "Not found");
+     } else if (strcmp(method, "OPTIONS") == 0) {
+         http_set_response(conn, 204, "No Content", NULL);
+     } else if (profile) {
+         if (strcmp(method, "POST") == 0) http_handle_profile(conn, body, body_len);
+         else http_set_error(conn, 405, "Method Not Allowed", "Method not allowed");
+     } else if (reach) {
+         if (strcmp(method, "POST") == 0) http_handle_reach(conn, body, body_len, ctx);
+         else http_set_error(conn, 405, "Method Not Allowed", "Method not allowed");
+     } else if (arrive_by) {
+         if (strcmp(method, "POST") == 0) http_handle_arrive_by(conn, body, body_len, ctx);
+         else http_set_error(conn, 405, "Method Not Allowed", "Method not allowed");
+     } else if (stats) {
+         if (strcmp(method, "GET") == 0) http_handle_stats(conn, path[5] == 't');
+         else http_set_error(conn, 405, "Method Not Allowed", "Method not allowed");
+     } else if (booking) {
+         if (strcmp(method, "POST") != 0) http_set_error(conn, 405, "Method Not Allowed", "Method not allowed");
+         else if (path[5] == 'c') http_handle_cancel(conn, body, body_len, journal);
+         else http_handle_booking(conn, body, body_len, journal);
+     } else if (reload) {
+         if (strcmp(method, "POST") == 0) http_handle_reload(conn, timetable_file);
+         else http_set_error(conn, 405, "Method Not Allowed", "Method not allowed");
+     } else if (delta) {
+         if (strcmp(method, "POST") == 0) http_handle_delta(conn, body, body_len);
+         else http_set_error(conn, 405, "Method Not Allowed", "Method not allowed");
+     } else if (strcmp(method, "POST") == 0) {
+         http_handle_search(conn, body, body_len, ctx);
+     } else if (strcmp(method, "GET") == 0) {
+         http_set_response(conn, 200, "OK", "{\"message\":\"Use POST with JSON body to get flight data.\"}");
+     } else {
+         http_set_error(conn, 405, "Method Not Allowed", "Method not allowed");
+     }
+ }
 
-//format departure time from minutes to string
-char time_str[6];
-minutes_to_time(departure_time, time_str);
-cJSON_AddStringToObject(root, "departure_time", time_str);
+//http worker thread, serves queued requests until the server stops
+ void* http_worker(void* arg) {
+     block_server_signals();
+     HttpServer* server = (HttpServer*)arg;
+     SearchContext* ctx = search_context_create();
 
-//if available, the cheapest journey
-if (cheapest_path_size > 0) {
-cJSON* cheapest_journey = cJSON_CreateObject();
-cJSON* cheapest_segments = cJSON_CreateArray();
-double total_cost = 0;
-int total_duration = 0;
+     pthread_mutex_lock(&server->lock);
+     while (true) {
+         while (!server->queue_head && !server->stopping) {
+             pthread_cond_wait(&server->has_work, &server->lock);
+         }
+         if (!server->queue_head) break;
+         HttpConnection* conn = server->queue_head;
+         server->queue_head = conn->next;
+         if (!server->queue_head) server->queue_tail = NULL;
+         pthread_mutex_unlock(&server->lock);
 
-//adding each flight node
-for (int i = 0; i < cheapest_path_size; i++) {
-ScheduledFlight* f = &flights[cheapest_path[i]];
-cJSON* segment = cJSON_CreateObject();
+         http_handle_request(conn, ctx, server->journal, server->timetable_file);
 
-//add node details
-cJSON_AddStringToObject(segment, "from", f->from);
-cJSON_AddStringToObject(segment, "to", f->to);
-cJSON_AddStringToObject(segment, "day", f->day_of_week);
+         pthread_mutex_lock(&server->lock);
+         conn->next = server->completed;
+         server->completed = conn;
+         uint64_t one = 1;
+         if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+             //the counter is already non zero, the loop will wake up anyway
+         }
+     }
+     pthread_mutex_unlock(&server->lock);
 
-minutes_to_time(f->departure_time, time_str);
-cJSON_AddStringToObject(segment, "departure_time", time_str);
+     search_context_destroy(ctx);
+     return NULL;
+ }
 
-minutes_to_time(f->arrival_time, time_str);
-cJSON_AddStringToObject(segment, "arrival_time", time_str);
+ void http_close_connection(HttpServer* server, HttpConnection* conn) {
+     if (conn->prev_open) conn->prev_open->next_open = conn->next_open;
+     else server->open = conn->next_open;
+     if (conn->next_open) conn->next_open->prev_open = conn->prev_open;
+     epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+     close(conn->fd);
+     free(conn->out);
+     free(conn);
+ }
 
-cJSON_AddNumberToObject(segment, "duration", f->duration);
-cJSON_AddNumberToObject(segment, "cost", f->cost);
-cJSON_AddNumberToObject(segment, "distance", f->distance);
+ void http_watch(HttpServer* server, HttpConnection* conn, uint32_t events) {
+     struct epoll_event ev;
+     ev.events = events;
+     ev.data.ptr = conn;
+     epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+ }
 
-cJSON_AddItemToArray(cheapest_segments, segment);
+bool http_flush(HttpServer* server, HttpConnection* conn);
 
-//calculate the total cost and flight duration
-total_cost += f->cost;
-total_duration += f->duration;
-}
+//answers a request the loop will not queue and closes the connection once the answer is out
+ bool http_reject(HttpServer* server, HttpConnection* conn, int status, const char* reason, const char* message) {
+     conn->keep_alive = false;
+     http_set_error(conn, status, reason, message);
+     if (conn->out_len == 0) return false;
+     return http_flush(server, conn);
+ }
 
-//add the total cost and flight duration and the nodes
-cJSON_AddNumberToObject(cheapest_journey, "total_cost", total_cost);
-cJSON_AddNumberToObject(cheapest_journey, "total_duration", total_duration);
-cJSON_AddItemToObject(cheapest_journey, "segments", cheapest_segments);
-cJSON_AddItemToObject(journeys, "cheapest", cheapest_journey);
-}
+/* looks for a complete request in the buffer and queues it for a worker
+ returns false if the connection has to be closed
+*/
+ bool http_dispatch(HttpServer* server, HttpConnection* conn) {
+     if (conn->in_len == 0) return true;
+     conn->in[conn->in_len] = '\0';
+     char* header_end = strstr(conn->in, "\r\n\r\n");
+     if (!header_end) {
+         //a header that fills the whole buffer never completes
+         if (conn->in_len < MAX_REQUEST_SIZE - 1) return true;
+         return http_reject(server, conn, 413, "Payload Too Large", "The request header is too large");
+     }
+     int header_len = (int)(header_end - conn->in) + 4;
+     int content_length = 0;
+     char value[32];
+     if (http_header_value(conn->in, "Content-Length", value, sizeof(value))) {
+         //only digits, and no more than the buffer holds
+         char* end;
+         errno = 0;
+         long length = strtol(value, &end, 10);
+         while (*end == ' ' || *end == '\t') end++;
+         if (end == value || *end != '\0' || length < 0) {
+             return http_reject(server, conn, 400, "Bad Request", "Invalid Content-Length");
+         }
+         if (errno != 0 || length > MAX_REQUEST_SIZE - 1 - header_len) {
+             return http_reject(server, conn, 413, "Payload Too Large", "The request body is too large");
+         }
+         content_length = (int)length;
+     }
+     if (conn->in_len < header_len + content_length) return true;
 
-//if available the fastest journey
-if (fastest_path_size > 0) {
-cJSON* fastest_journey = cJSON_CreateObject();
-cJSON* fastest_segments = cJSON_CreateArray();
-double total_cost = 0;
-int total_duration = 0;
+     conn->request_len = header_len + content_length;
+     //keep-alive is the default from http/1.1 on
+     bool http10 = strstr(conn->in, " HTTP/1.0\r\n") != NULL && strstr(conn->in, " HTTP/1.0\r\n") < header_end;
+     conn->keep_alive = !http10;
+     if (http_header_value(conn->in, "Connection", value, sizeof(value))) {
+         if (strcasecmp(value, "close") == 0) conn->keep_alive = false;
+         else if (strcasecmp(value, "keep-alive") == 0) conn->keep_alive = true;
+     }
 
-//adding each flight node
-for (int i = 0; i < fastest_path_size; i++) {
-ScheduledFlight* f = &flights[fastest_path[i]];
-cJSON* segment = cJSON_CreateObject();
+     //the loop stops watching the socket until the response is ready
+     conn->busy = true;
+     http_watch(server, conn, 0);
+     pthread_mutex_lock(&server->lock);
+     conn->next = NULL;
+     if (server->queue_tail) server->queue_tail->next = conn;
+     else server->queue_head = conn;
+     server->queue_tail = conn;
+     pthread_cond_signal(&server->has_work);
+     pthread_mutex_unlock(&server->lock);
+     return true;
+ }
 
-//node information
-cJSON_AddStringToObject(segment, "from", f->from);
-cJSON_AddStringToObject(segment, "to", f->to);
-cJSON_AddStringToObject(segment, "day", f->day_of_week);
+//sends what is left of the response, returns false if the connection has to be closed
+ bool http_flush(HttpServer* server, HttpConnection* conn) {
+     while (conn->out_sent < conn->out_len) {
+         ssize_t n = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+         if (n < 0) {
+             if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                 http_watch(server, conn, EPOLLOUT);
+                 return true;
+             }
+             if (errno == EINTR) continue;
+             return false;
+         }
+         conn->out_sent += (int)n;
+     }
+     if (!conn->keep_alive) return false;
 
-minutes_to_time(f->departure_time, time_str);
-cJSON_AddStringToObject(segment, "departure_time", time_str);
+     //drop the served request, a pipelined one behind it moves to the front
+     free(conn->out);
+     conn->out = NULL;
+     conn->out_len = conn->out_sent = 0;
+     memmove(conn->in, conn->in + conn->request_len, conn->in_len - conn->request_len);
+     conn->in_len -= conn->request_len;
+     conn->request_len = 0;
+     http_watch(server, conn, EPOLLIN | EPOLLRDHUP);
+     return http_dispatch(server, conn);
+ }
 
-minutes_to_time(f->arrival_time, time_str);
-cJSON_AddStringToObject(segment, "arrival_time", time_str);
+//reads what the peer sent, returns false if the connection has to be closed
+ bool http_read(HttpServer* server, HttpConnection* conn) {
+     while (conn->in_len < MAX_REQUEST_SIZE - 1) {
+         ssize_t n = recv(conn->fd, conn->in + conn->in_len, MAX_REQUEST_SIZE - 1 - conn->in_len, 0);
+         if (n == 0) return false;
+         if (n < 0) {
+             if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+             if (errno == EINTR) continue;
+             return false;
+         }
+         conn->in_len += (int)n;
+     }
+     return http_dispatch(server, conn);
+ }
 
-cJSON_AddNumberToObject(segment, "duration", f->duration);
-cJSON_AddNumberToObject(segment, "cost", f->cost);
-cJSON_AddNumberToObject(segment, "distance", f->distance);
+ void http_accept(HttpServer* server) {
+     while (true) {
+         struct sockaddr_in peer;
+         socklen_t peer_len = sizeof(peer);
+         int fd = accept4(server->listen_fd, (struct sockaddr*)&peer, &peer_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+         if (fd < 0) return;
+         int one = 1;
+         setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+         HttpConnection* conn = (HttpConnection*)calloc(1, sizeof(HttpConnection));
+         if (!conn) {
+             close(fd);
+             continue;
+         }
+         conn->fd = fd;
+         conn->local = (ntohl(peer.sin_addr.s_addr) >> 24) == 127;
+         struct epoll_event ev;
+         ev.events = EPOLLIN | EPOLLRDHUP;
+         ev.data.ptr = conn;
+         if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+             close(fd);
+             free(conn);
+             continue;
+         }
+         conn->next_open = server->open;
+         if (server->open) server->open->prev_open = conn;
+         server->open = conn;
+     }
+ }
 
-cJSON_AddItemToArray(fastest_segments, segment);
+//sends the responses the workers finished since the last wake up
+ void http_complete(HttpServer* server) {
+     uint64_t count;
+     if (read(server->wake_fd, &count, sizeof(count)) < 0) {
+         //nothing to read, another wake up already took the list
+     }
+     pthread_mutex_lock(&server->lock);
+     HttpConnection* conn = server->completed;
+     server->completed = NULL;
+     pthread_mutex_unlock(&server->lock);
 
-total_cost += f->cost;
-total_duration += f->duration;
-}
+     while (conn) {
+         HttpConnection* next = conn->next;
+         conn->busy = false;
+         if (conn->closing || !http_flush(server, conn)) {
+             http_close_connection(server, conn);
+         }
+         conn = next;
+     }
+ }
 
-cJSON_AddNumberToObject(fastest_journey, "total_cost", total_cost);
-cJSON_AddNumberToObject(fastest_journey, "total_duration", total_duration);
-cJSON_AddItemToObject(fastest_journey, "segments", fastest_segments);
-cJSON_AddItemToObject(journeys, "fastest", fastest_journey);
-}
+//opens the listening socket on all interfaces, -1 on errors
+ int http_listen(int port) {
+     int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+     if (fd < 0) return -1;
+     int one = 1;
+     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+     struct sockaddr_in addr;
+     memset(&addr, 0, sizeof(addr));
+     addr.sin_family = AF_INET;
+     addr.sin_addr.s_addr = htonl(INADDR_ANY);
+     addr.sin_port = htons((uint16_t)port);
+     if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+         close(fd);
+         return -1;
+     }
+     return fd;
+ }
 
-//if avialble, the optimal journey
-if (optimal_path_size > 0) {
-cJSON* optimal_journey = cJSON_CreateObject();
-cJSON* optimal_segments = cJSON_CreateArray();
-double total_cost = 0;
-int total_duration = 0;
+/* serves /api/data, /api/profile, /api/book and /api/cancel on the given port until SIGINT or SIGTERM
+ the searches read whichever timetable is published when the request comes in
+ SIGUSR1 prints the phase latencies, local clients can GET them from /api/stats
+ and the recent phases as a Chrome trace from /api/trace, POST /api/reload
+ to publish timetable_file again and POST /api/delta to publish a delta of it
+*/
+ bool run_http_server(int port, int num_workers, BookingJournal* journal, const char* timetable_file) {
+     HttpServer server;
+     memset(&server, 0, sizeof(server));
+     server.journal = journal;
+     server.timetable_file = timetable_file;
+     server.listen_fd = http_listen(port);
+     if (server.listen_fd < 0) {
+         fprintf(stderr, "Error: Could not listen on port %d: %s\n", port, strerror(errno));
+         return false;
+     }
+     server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+     server.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+     server.workers = (pthread_t*)malloc(num_workers * sizeof(pthread_t));
+     if (server.epoll_fd < 0 || server.wake_fd < 0 || !server.workers) {
+         fprintf(stderr, "Error: Could not set up the server\n");
+         if (server.epoll_fd >= 0) close(server.epoll_fd);
+         if (server.wake_fd >= 0) close(server.wake_fd);
+         close(server.listen_fd);
+         free(server.workers);
+         return false;
+     }
+     pthread_mutex_init(&server.lock, NULL);
+     pthread_cond_init(&server.has_work, NULL);
 
-//each flight node
-for (int i = 0; i < optimal_path_size; i++) {
-ScheduledFlight* f = &flights[optimal_path[i]];
-cJSON* segment = cJSON_CreateObject();
+     //the listening socket and the eventfd are told apart by their data pointer
+     struct epoll_event ev;
+     ev.events = EPOLLIN;
+     ev.data.ptr = &server.listen_fd;
+     epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &ev);
+     ev.data.ptr = &server.wake_fd;
+     epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.wake_fd, &ev);
 
-//node details
-cJSON_AddStringToObject(segment, "from", f->from);
-cJSON_AddStringToObject(segment, "to", f->to);
-cJSON_AddStringToObject(segment, "day", f->day_of_week);
+     //the handlers only set a flag, without SA_RESTART the signal also breaks
+     //the loop out of epoll_wait to act on it, the workers block the signals
+     struct sigaction action;
+     memset(&action, 0, sizeof(action));
+     sigemptyset(&action.sa_mask);
+     action.sa_handler = SIG_IGN;
+     sigaction(SIGPIPE, &action, NULL);
+     action.sa_handler = handle_stop_signal;
+     sigaction(SIGINT, &action, NULL);
+     sigaction(SIGTERM, &action, NULL);
+     action.sa_handler = handle_stats_signal;
+     sigaction(SIGUSR1, &action, NULL);
 
-minutes_to_time(f->departure_time, time_str);
-cJSON_AddStringToObject(segment, "departure_time", time_str);
+     for (int i = 0; i < num_workers; i++) {
+         if (pthread_create(&server.workers[server.num_workers], NULL, http_worker, &server) == 0)
+             server.num_workers++;
+     }
+     bool ok = server.num_workers > 0;
+     if (!ok) fprintf(stderr, "Error: Could not start the http workers\n");
 
-minutes_to_time(f->arrival_time, time_str);
-cJSON_AddStringToObject(segment, "arrival_time", time_str);
+     if (ok) printf("Listening on port %d with %d workers\n", port, server.num_workers);
+     fflush(stdout);
 
-cJSON_AddNumberToObject(segment, "duration", f->duration);
-cJSON_AddNumberToObject(segment, "cost", f->cost);
-cJSON_AddNumberToObject(segment, "distance", f->distance);
+     struct epoll_event events[MAX_EVENTS];
+     while (ok && !server_stop_requested) {
+         if (stats_dump_requested) {
+             stats_dump_requested = 0;
+             cJSON* stats = phase_stats_json();
+             char* json_str = cJSON_Print(stats);
+             if (json_str) fprintf(stderr, "%s\n", json_str);
+             free(json_str);
+             cJSON_Delete(stats);
+         }
+         int n = epoll_wait(server.epoll_fd, events, MAX_EVENTS, -1);
+         if (n < 0) {
+             if (errno == EINTR) continue;
+             fprintf(stderr, "Error: epoll_wait failed: %s\n", strerror(errno));
+             break;
+         }
+         for (int i = 0; i < n; i++) {
+             if (events[i].data.ptr == &server.listen_fd) {
+                 http_accept(&server);
+                 continue;
+             }
+             if (events[i].data.ptr == &server.wake_fd) {
+                 http_complete(&server);
+                 continue;
+             }
+             HttpConnection* conn = (HttpConnection*)events[i].data.ptr;
+             if (conn->busy) {
+                 //the peer hung up while its request is at a worker
+                 if (events[i].events & (EPOLLHUP | EPOLLERR)) conn->closing = true;
+                 continue;
+             }
+             bool keep = true;
+             if (events[i].events & (EPOLLHUP | EPOLLERR)) keep = false;
+             else if (events[i].events & EPOLLOUT) keep = http_flush(&server, conn);
+             else if (events[i].events & (EPOLLIN | EPOLLRDHUP)) keep = http_read(&server, conn);
+             if (!keep && !conn->busy) http_close_connection(&server, conn);
+         }
+     }
 
-cJSON_AddItemToArray(optimal_segments, segment);
+     //let the workers finish what is queued, then close whatever is left open
+     pthread_mutex_lock(&server.lock);
+     server.stopping = true;
+     pthread_cond_broadcast(&server.has_work);
+     pthread_mutex_unlock(&server.lock);
+     for (int i = 0; i < server.num_workers; i++) {
+         pthread_join(server.workers[i], NULL);
+     }
+     //the workers are gone, so every connection, busy, completed or idle, is the loop's
+     while (server.open) {
+         http_close_connection(&server, server.open);
+     }
+     pthread_cond_destroy(&server.has_work);
+     pthread_mutex_destroy(&server.lock);
+     close(server.wake_fd);
+     close(server.epoll_fd);
+     close(server.listen_fd);
+     free(server.workers);
+     return ok;
+ }
+#endif
 
-total_cost += f->cost;
-total_duration += f->duration;
+/* in-process interface, used by flightsrun.py through ctypes
+ build it as a shared library with the command line main left out:
+   gcc -O2 -shared -fPIC -pthread -DPLANEBOOKING_LIBRARY main.c cJSON/cJSON.c -lm -o libplanebooking.so
+ a loaded timetable is an opaque handle, searches on it run on a worker pool
+ shared by all callers and the result is the same json document main writes
+ to output.json, returned in memory
+*/
+pthread_once_t library_pool_once = PTHREAD_ONCE_INIT;
+WorkerPool* library_pool = NULL;
+
+void create_library_pool(void) {
+    library_pool = worker_pool_create(NUM_ROUTE_TYPES);
 }
 
-cJSON_AddNumberToObject(optimal_journey, "total_cost", total_cost);
-cJSON_AddNumberToObject(optimal_journey, "total_duration", total_duration);
-cJSON_AddItemToObject(optimal_journey, "segments", optimal_segments);
-cJSON_AddItemToObject(journeys, "optimal", optimal_journey);
+//loads a timetable, returns NULL on errors
+//the handle is given back with planebooking_release
+Timetable* planebooking_load(const char* filename) {
+    return parse_json_input(filename);
 }
 
-//add all journeys to the root
-cJSON_AddItemToObject(root, "journeys", journeys);
+void planebooking_release(Timetable* tt) {
+    timetable_release(tt);
+}
 
-//writing to the file in the json format
-char* json_str = cJSON_Print(root);
-FILE* fp = fopen(filename, "w");
-if (!fp) {
-    //handles the file oppening error
-cJSON_Delete(root);
-free(json_str);
-return false;
+//applies a delta file, see apply_delta_file, returns a new handle and leaves
+//tt as it was, NULL if the file could not be applied
+Timetable* planebooking_apply_delta(const Timetable* tt, const char* filename) {
+    return apply_timetable_delta(tt, filename);
 }
 
-fputs(json_str, fp);
-fclose(fp);
+//parse_search_constraints for the json text a library call gets
+bool parse_constraints_text(const Timetable* tt, const char* text, SearchConstraints* limits, char* error) {
+    cJSON* json = cJSON_Parse(text);
+    if (!json) {
+        snprintf(error, MAX_ERROR_LENGTH, "Constraints are not valid json");
+        return false;
+    }
+    bool valid = parse_search_constraints(tt, json, limits, error);
+    cJSON_Delete(json);
+    return valid;
+}
 
-//frees up the allocated memory
-cJSON_Delete(root);
-free(json_str);
-return true;
+//checks constraints as planebooking_search_constrained reads them, returns 1
+//if they are valid, else 0 with the reason in error, which gets at most
+//error_size bytes, so a caller can tell a bad query from a failed search
+int planebooking_check_constraints(const Timetable* tt, const char* constraints, char* error, int error_size) {
+    SearchConstraints limits;
+    char reason[MAX_ERROR_LENGTH];
+    if (parse_constraints_text(tt, constraints, &limits, reason)) return 1;
+    if (error && error_size > 0) snprintf(error, (size_t)error_size, "%s", reason);
+    return 0;
 }
 
-//function which finds the airport index
-//it searches an airport in tha array by its code
-int find_airport_index(const char* code) {
-    //linear search throught the airports array
-    for (int i = 0; i < num_airports; i++) {
-        if (strcmp(airports[i].code, code) == 0) {
-            return i;
+//runs the three route searches and returns the result as an unformatted
+//json string, or NULL if it could not be built, free it with planebooking_free
+//constraints is a json object as in parse_search_constraints, NULL for none
+//the searches answer within deadline_ms, with the best journeys found by then,
+//see add_search_status, 0 lets them run to the end
+//identical calls made at the same time share one search, see shared_route_search
+char* planebooking_search_constrained(const Timetable* tt, const char* from, const char* to,
+                                      const char* day, int departure_time, const char* constraints,
+                                      int deadline_ms) {
+    long long deadline_us = search_deadline(deadline_ms);
+    long long started = monotonic_ns();
+    SearchConstraints limits;
+    if (constraints) {
+        char error[MAX_ERROR_LENGTH];
+        if (!parse_constraints_text(tt, constraints, &limits, error)) {
+            fprintf(stderr, "Error: %s\n", error);
+            return NULL;
         }
     }
-    //error
-    fprintf(stderr, "Airport not found: %s\n", code);
-    return -1;  
+    phase_record(PHASE_PARSE, started);
+
+    pthread_once(&library_pool_once, create_library_pool);
+    SearchContext* ctx = library_pool ? NULL : search_context_create();
+    if (!library_pool && !ctx) return NULL;
+
+    //callers asking the same of the same timetable at once share one search
+    char* json_str = shared_route_search(library_pool, ctx, tt, NULL, from, to, day, departure_time,
+                                         constraints, constraints ? &limits : NULL, deadline_ms, deadline_us);
+    search_context_destroy(ctx);
+    return json_str;
 }
 
-//calculates the cost of a flight journey based on the route type
-//the different route types use other criteria to detrmine the best path
-double calculate_route_cost(RouteType route_type, double cost, int duration, double distance) {
-    switch (route_type) {
-        case CHEAPEST:
-        //just about the money
-            return cost;  
-            
-        case FASTEST:
-        //time efficiency
-            return duration; 
-            
-        case OPTIMAL:
-        //balanced
-        //(0.1 cost units per minute)
-            return cost + (duration * 0.1);
-            
-        default:
-            fprintf(stderr, "Invalid route type\n");
-            return cost;
+//the same without constraints or a deadline
+char* planebooking_search(const Timetable* tt, const char* from, const char* to,
+                          const char* day, int departure_time) {
+    return planebooking_search_constrained(tt, from, to, day, departure_time, NULL, 0);
+}
+
+//the latencies of the phases of the searches so far, see phase_stats_json
+//returns an unformatted json string, free it with planebooking_free
+char* planebooking_stats(void) {
+    cJSON* root = phase_stats_json();
+    char* json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json_str;
+}
+
+//the recent phases as a Chrome trace, see trace_json, free it with planebooking_free
+char* planebooking_trace(void) {
+    return trace_json();
+}
+
+//the pareto journeys leaving over a window of window minutes, see profile_search
+//returns an unformatted json string or NULL, free it with planebooking_free
+char* planebooking_profile(const Timetable* tt, const char* from, const char* to,
+                           const char* day, int departure_time, int window) {
+    int day_index = find_day_index(day);
+    if (day_index < 0) return NULL;
+    cJSON* root = profile_search(tt, NULL, from, to, day_index * 1440 + departure_time, window);
+    if (!root) return NULL;
+    char* json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json_str;
+}
+
+//the journey that arrives by arrival_time on day and leaves the latest, see
+//arrive_by_search, returns an unformatted json string or NULL
+char* planebooking_arrive_by(const Timetable* tt, const char* from, const char* to,
+                             const char* day, int arrival_time) {
+    int day_index = find_day_index(day);
+    SearchContext* ctx = search_context_create();
+    if (day_index < 0 || !ctx) {
+        search_context_destroy(ctx);
+        return NULL;
     }
+    cJSON* root = arrive_by_search(tt, NULL, ctx, from, to, day_index * 1440 + arrival_time);
+    search_context_destroy(ctx);
+    if (!root) return NULL;
+    char* json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json_str;
+}
+
+//the airports reachable within a budget, see reachability_search, metric is
+//cost, duration or optimal, returns an unformatted json string or NULL
+char* planebooking_reach(const Timetable* tt, const char* from, const char* day,
+                         int departure_time, const char* metric, double budget) {
+    int route_type = find_budget_metric(metric);
+    if (route_type < 0 || find_day_index(day) < 0 || !valid_budget(budget)) return NULL;
+    SearchContext* ctx = search_context_create();
+    if (!ctx) return NULL;
+    cJSON* root = reachability_search(tt, NULL, ctx, from, day, departure_time, (RouteType)route_type, budget);
+    search_context_destroy(ctx);
+    if (!root) return NULL;
+    char* json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json_str;
+}
+
+void planebooking_free(char* json_str) {
+    free(json_str);
 }
 
+#ifndef PLANEBOOKING_LIBRARY
 int main(int argc, char* argv[]) {
+#ifdef __linux__
+    //server mode, answers /api/data over http instead of writing one output file
+    if (argc >= 3 && strcmp(argv[2], "--serve") == 0) {
+        int port = (argc > 3) ? atoi(argv[3]) : DEFAULT_PORT;
+        Timetable* loaded = parse_json_input(argv[1]);
+        if (!loaded) {
+            fprintf(stderr, "Failed to parse input file %s\n", argv[1]);
+            return 1;
+        }
+        printf("Loaded %d airports and %d flights\n", loaded->num_airports, loaded->num_flights);
+        timetable_publish(loaded);
+
+        //the seats sold before the restart come back from the journal
+        BookingJournal* journal = booking_journal_open(loaded, BOOKING_SNAPSHOT_FILE,
+                                                       BOOKING_LOG_FILE, DEFAULT_COMMIT_BATCH);
+        if (!journal) fprintf(stderr, "Warning: Bookings are disabled, the journal could not be opened\n");
+
+        //fares follow the load factor and the time to departure from now on
+        PricingThread* pricing = pricing_start(FARE_UPDATE_INTERVAL);
+        if (!pricing) fprintf(stderr, "Warning: Could not start pricing, the static fares apply\n");
+
+        //a worker waiting for its booking to be committed does not search meanwhile,
+        //so there are more workers than cores
+        int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        bool served = run_http_server(port, (cpus > 1 ? cpus : 1) * 4, journal, argv[1]);
+        pricing_stop(pricing);
+        fare_table_publish(NULL);
+        booking_journal_close(journal);
+        timetable_publish(NULL);
+        return served ? 0 : 1;
+    }
+#endif
+
+    //profile mode, the journeys over a departure window instead of the three routes
+    if (argc >= 3 && strcmp(argv[2], "--profile") == 0) {
+        if (argc < 9) {
+            printf("Usage: %s <input.json> --profile <output.json> <from> <to> <day> <departure_time> <window_minutes>\n", argv[0]);
+            return 1;
+        }
+        int day_index = find_day_index(argv[6]);
+        if (day_index < 0) {
+            fprintf(stderr, "Error: Invalid day %s\n", argv[6]);
+            return 1;
+        }
+        Timetable* tt = parse_json_input(argv[1]);
+        if (!tt) {
+            fprintf(stderr, "Failed to parse input file %s\n", argv[1]);
+            return 1;
+        }
+        cJSON* root = profile_search(tt, NULL, argv[4], argv[5], day_index * 1440 + atoi(argv[7]), atoi(argv[8]));
+        timetable_release(tt);
+        if (!root) return 1;
+        char* json_str = cJSON_Print(root);
+        printf("Found %d journeys\n", cJSON_GetArraySize(cJSON_GetObjectItem(root, "journeys")));
+        cJSON_Delete(root);
+        FILE* fp = fopen(argv[3], "w");
+        if (!fp || fputs(json_str, fp) < 0) {
+            fprintf(stderr, "Failed to write output file %s\n", argv[3]);
+            if (fp) fclose(fp);
+            free(json_str);
+            return 1;
+        }
+        fclose(fp);
+        free(json_str);
+        printf("Results successfully written to %s\n", argv[3]);
+        return 0;
+    }
+
+    //reachability mode, every airport within a budget of the origin
+    if (argc >= 3 && strcmp(argv[2], "--reach") == 0) {
+        if (argc < 9) {
+            printf("Usage: %s <input.json> --reach <output.json> <from> <day> <departure_time> <cost|duration|optimal> <budget>\n", argv[0]);
+            return 1;
+        }
+        int route_type = find_budget_metric(argv[7]);
+        if (route_type < 0) {
+            fprintf(stderr, "Error: Invalid metric %s\n", argv[7]);
+            return 1;
+        }
+        if (find_day_index(argv[5]) < 0) {
+            fprintf(stderr, "Error: Invalid day %s\n", argv[5]);
+            return 1;
+        }
+        double budget = atof(argv[8]);
+        if (!valid_budget(budget)) {
+            fprintf(stderr, "Error: Invalid budget %s\n", argv[8]);
+            return 1;
+        }
+        Timetable* tt = parse_json_input(argv[1]);
+        SearchContext* ctx = search_context_create();
+        if (!tt || !ctx) {
+            fprintf(stderr, "Failed to parse input file %s\n", argv[1]);
+            search_context_destroy(ctx);
+            timetable_release(tt);
+            return 1;
+        }
+        cJSON* root = reachability_search(tt, NULL, ctx, argv[4], argv[5], atoi(argv[6]),
+                                          (RouteType)route_type, budget);
+        search_context_destroy(ctx);
+        timetable_release(tt);
+        if (!root) return 1;
+        char* json_str = cJSON_Print(root);
+        printf("Found %d reachable airports\n", cJSON_GetArraySize(cJSON_GetObjectItem(root, "airports")));
+        cJSON_Delete(root);
+        FILE* fp = fopen(argv[3], "w");
+        if (!fp || fputs(json_str, fp) < 0) {
+            fprintf(stderr, "Failed to write output file %s\n", argv[3]);
+            if (fp) fclose(fp);
+            free(json_str);
+            return 1;
+        }
+        fclose(fp);
+        free(json_str);
+        printf("Results successfully written to %s\n", argv[3]);
+        return 0;
+    }
+
+    //arrive-by mode, the journey that lands in time and leaves the latest
+    if (argc >= 3 && strcmp(argv[2], "--arrive-by") == 0) {
+        if (argc < 8) {
+            printf("Usage: %s <input.json> --arrive-by <output.json> <from> <to> <day> <arrival_time>\n", argv[0]);
+            return 1;
+        }
+        int day_index = find_day_index(argv[6]);
+        if (day_index < 0) {
+            fprintf(stderr, "Error: Invalid day %s\n", argv[6]);
+            return 1;
+        }
+        Timetable* tt = parse_json_input(argv[1]);
+        SearchContext* ctx = search_context_create();
+        if (!tt || !ctx) {
+            fprintf(stderr, "Failed to parse input file %s\n", argv[1]);
+            search_context_destroy(ctx);
+            timetable_release(tt);
+            return 1;
+        }
+        cJSON* root = arrive_by_search(tt, NULL, ctx, argv[4], argv[5], day_index * 1440 + atoi(argv[7]));
+        search_context_destroy(ctx);
+        timetable_release(tt);
+        if (!root) return 1;
+        cJSON* journey = cJSON_GetObjectItem(root, "journey");
+        if (journey) {
+            printf("Latest departure: %s %s\n", cJSON_GetObjectItem(journey, "departure_day")->valuestring,
+                   cJSON_GetObjectItem(journey, "departure_time")->valuestring);
+        } else {
+            printf("No journey arrives in time\n");
+        }
+        char* json_str = cJSON_Print(root);
+        cJSON_Delete(root);
+        FILE* fp = fopen(argv[3], "w");
+        if (!fp || fputs(json_str, fp) < 0) {
+            fprintf(stderr, "Failed to write output file %s\n", argv[3]);
+            if (fp) fclose(fp);
+            free(json_str);
+            return 1;
+        }
+        fclose(fp);
+        free(json_str);
+        printf("Results successfully written to %s\n", argv[3]);
+        return 0;
+    }
+
     //validating the command line arguments
     if (argc < 6) {
-        printf("Usage: %s <input.json> <output.json> <from> <to> <day> [departure_time]\n", argv[0]);
+        printf("Usage: %s <input.json> <output.json> <from> <to> <day> [departure_time] [delta.json]\n", argv[0]);
+#ifdef __linux__
+        printf("       %s <input.json> --serve [port]\n", argv[0]);
+#endif
+        printf("       %s <input.json> --profile <output.json> <from> <to> <day> <departure_time> <window_minutes>\n", argv[0]);
+        printf("       %s <input.json> --reach <output.json> <from> <day> <departure_time> <cost|duration|optimal> <budget>\n", argv[0]);
+        printf("       %s <input.json> --arrive-by <output.json> <from> <to> <day> <arrival_time>\n", argv[0]);
         printf("Example: %s flights.json result.json JFK LAX monday 480\n", argv[0]);
         return 1;
     }
@@ -889,55 +5994,104 @@ int main(int argc, char* argv[]) {
     int departure_time = (argc > 6) ? atoi(argv[6]) : 480; 
 
     //load and parse the data from the JSON data.json file
-    if (!parse_json_input(input_file)) {
+    long long load_started = monotonic_ns();
+    Timetable* loaded = parse_json_input(input_file);
+    if (!loaded) {
         fprintf(stderr, "Failed to parse input file %s\n", input_file);
         return 1;
     }
+    printf("Loaded %d airports and %d flights\n", loaded->num_airports, loaded->num_flights);
+    timetable_publish(loaded);
 
-    printf("Loaded %d airports and %d flights\n", num_airports, num_flights);
+    //apply the schedule changes published since the timetable was written
+    if (argc > 7) {
+        Timetable* base = timetable_acquire();
+        Timetable* updated = apply_timetable_delta(base, argv[7]);
+        timetable_release(base);
+        if (!updated) {
+            fprintf(stderr, "Failed to apply delta file %s\n", argv[7]);
+            return 1;
+        }
+        printf("Applied delta %s, %d flights\n", argv[7], updated->num_flights);
+        timetable_publish(updated);
+    }
+
+    //the searches and the output all read the same snapshot
+    Timetable* tt = timetable_acquire();
+    phase_record(PHASE_TIMETABLE, load_started);
+#ifdef ALLOC_ACCOUNTING
+    //the searches run on the pool, so the query is counted over all threads
+    AllocTally allocs;
+    alloc_tally(&allocs, false);
+#endif
+
+    //the three route types are separate searches, so they run at the same time
+    //on the worker pool, or one after another if no thread could be started
+    WorkerPool* pool = worker_pool_create(NUM_ROUTE_TYPES);
+    SearchContext* ctx = pool ? NULL : search_context_create();
+    if (!pool && !ctx) {
+        timetable_release(tt);
+        return 1;
+    }
 
-    //Initializing the path array for the 3 route types
-    int cheapest_path[MAX_PATH];
-    int cheapest_path_size = 0;
-    
-    int fastest_path[MAX_PATH];
-    int fastest_path_size = 0;
-    
-    int optimal_path[MAX_PATH];
-    int optimal_path_size = 0;
-    
     //find the routes according to the route type criteria
-    bool found_cheapest = find_optimal_path(from_airport, to_airport, day, departure_time, 
-                                          CHEAPEST, cheapest_path, &cheapest_path_size);
-    
-    bool found_fastest = find_optimal_path(from_airport, to_airport, day, departure_time, 
-                                         FASTEST, fastest_path, &fastest_path_size);
-    
-    bool found_optimal = find_optimal_path(from_airport, to_airport, day, departure_time, 
-                                         OPTIMAL, optimal_path, &optimal_path_size);
+    SearchTask routes[NUM_ROUTE_TYPES];
+    //the command line answers with the static costs, so the same query gives the same result
+    init_route_tasks(routes, tt, NULL, from_airport, to_airport, day, departure_time, NULL, 0);
+    run_search_batch(pool, ctx, routes, NUM_ROUTE_TYPES);
+    worker_pool_destroy(pool);
+    search_context_destroy(ctx);
+
+    bool found_cheapest = routes[CHEAPEST].found;
+    bool found_fastest = routes[FASTEST].found;
+    bool found_optimal = routes[OPTIMAL].found;
 
     //check if any valid paths were found
     if (!found_cheapest && !found_fastest && !found_optimal) {
         fprintf(stderr, "No viable paths found from %s to %s\n", from_airport, to_airport);
+        timetable_release(tt);
         return 1;
     }
 
     //tell the console about the found paths
     printf("Found paths:\n");
-    if (found_cheapest) printf("- Cheapest: %d flight segments\n", cheapest_path_size);
-    if (found_fastest) printf("- Fastest: %d flight segments\n", fastest_path_size);
-    if (found_optimal) printf("- Optimal: %d flight segments\n", optimal_path_size);
+    if (found_cheapest) printf("- Cheapest: %d flight segments\n", routes[CHEAPEST].path_size);
+    if (found_fastest) printf("- Fastest: %d flight segments\n", routes[FASTEST].path_size);
+    if (found_optimal) printf("- Optimal: %d flight segments\n", routes[OPTIMAL].path_size);
 
     //writing the results to the json output file
-    if (!write_json_output(output_file, 
-                          cheapest_path, cheapest_path_size,
-                          fastest_path, fastest_path_size,
-                          optimal_path, optimal_path_size,
-                          from_airport, to_airport, day, departure_time)) {
+    bool written = write_json_output(tt, output_file, 
+                          routes[CHEAPEST].path, routes[CHEAPEST].path_size,
+                          routes[FASTEST].path, routes[FASTEST].path_size,
+                          routes[OPTIMAL].path, routes[OPTIMAL].path_size,
+                          from_airport, to_airport, day, departure_time);
+    timetable_release(tt);
+    if (!written) {
         fprintf(stderr, "Failed to write output file %s\n", output_file);
         return 1;
     }
 
     printf("Results successfully written to %s\n", output_file);
+#ifdef ALLOC_ACCOUNTING
+    char query[MAX_SEARCH_KEY];
+    snprintf(query, sizeof(query), "%s-%s %s %d", from_airport, to_airport, day, departure_time);
+    alloc_report("query", query, &allocs, false);
+#endif
+
+    //the phases of the run as a Chrome trace, if PLANEBOOKING_TRACE names a file
+    const char* trace_file = getenv("PLANEBOOKING_TRACE");
+    if (trace_file) {
+        char* trace = trace_json();
+        FILE* fp = trace ? fopen(trace_file, "w") : NULL;
+        if (fp) {
+            fputs(trace, fp);
+            fclose(fp);
+            printf("Trace written to %s\n", trace_file);
+        } else {
+            fprintf(stderr, "Error: Could not write trace file %s\n", trace_file);
+        }
+        free(trace);
+    }
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,137 @@
+/*
+  Seat reservation contention benchmark.
+
+  Every thread books the same hot flight until it is sold out, then tries
+  two segment itineraries that end on the sold out flight (they all have to
+  fail without keeping their first leg), and finally reserves and releases
+  one seat on the hot flight in a loop. The loop is run once on the lock free
+  counters and once on a mutex protected counter for comparison.
+
+  gcc -O2 -pthread seat_bench.c cJSON/cJSON.c -lm -o seat_bench
+  ./seat_bench <input.json> [threads] [rounds]
+*/
+
+#define PLANEBOOKING_LIBRARY
+#include "main.c"
+
+Timetable* bench_tt;
+int hot_flight;
+int rounds;
+atomic_int sold_by_threads;
+atomic_int phase;
+pthread_mutex_t baseline_lock = PTHREAD_MUTEX_INITIALIZER;
+int baseline_sold;
+
+double elapsed_seconds(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void* sell_out(void* arg) {
+    (void)arg;
+    while (reserve_seats(bench_tt, &hot_flight, 1, ECONOMY, 1)) {
+        atomic_fetch_add(&sold_by_threads, 1);
+    }
+    return NULL;
+}
+
+void* book_itinerary(void* arg) {
+    int first_leg = (int)(long)arg;
+    int itinerary[2] = {first_leg, hot_flight};
+    for (int i = 0; i < 100; i++) {
+        if (reserve_seats(bench_tt, itinerary, 2, ECONOMY, 1)) {
+            atomic_fetch_add(&sold_by_threads, 1);
+        }
+    }
+    return NULL;
+}
+
+void* churn(void* arg) {
+    (void)arg;
+    for (int i = 0; i < rounds; i++) {
+        if (reserve_seats(bench_tt, &hot_flight, 1, ECONOMY, 1)) {
+            release_seats(bench_tt, &hot_flight, 1, ECONOMY, 1);
+        }
+    }
+    return NULL;
+}
+
+void* churn_locked(void* arg) {
+    (void)arg;
+    int capacity = bench_tt->flights[hot_flight].seats[ECONOMY];
+    for (int i = 0; i < rounds; i++) {
+        pthread_mutex_lock(&baseline_lock);
+        bool booked = baseline_sold < capacity;
+        if (booked) baseline_sold++;
+        pthread_mutex_unlock(&baseline_lock);
+        if (booked) {
+            pthread_mutex_lock(&baseline_lock);
+            baseline_sold--;
+            pthread_mutex_unlock(&baseline_lock);
+        }
+    }
+    return NULL;
+}
+
+double run_threads(void* (*fn)(void*), int num_threads, bool distinct_args) {
+    pthread_t* threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < num_threads; t++) {
+        long leg = distinct_args ? (hot_flight + 1 + t) % bench_tt->num_flights : 0;
+        pthread_create(&threads[t], NULL, fn, (void*)leg);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    return elapsed_seconds(&start);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <input.json> [threads] [rounds]\n", argv[0]);
+        return 1;
+    }
+    int num_threads = (argc > 2) ? atoi(argv[2]) : 16;
+    rounds = (argc > 3) ? atoi(argv[3]) : 200000;
+
+    bench_tt = parse_json_input(argv[1]);
+    if (!bench_tt || bench_tt->num_flights < 2) {
+        fprintf(stderr, "Failed to load a timetable with at least two flights from %s\n", argv[1]);
+        return 1;
+    }
+    hot_flight = 0;
+    int capacity = bench_tt->flights[hot_flight].seats[ECONOMY];
+    printf("hot flight %s-%s %s, %d economy seats, %d threads\n",
+           bench_tt->flights[hot_flight].from, bench_tt->flights[hot_flight].to,
+           bench_tt->flights[hot_flight].day_of_week, capacity, num_threads);
+
+    //sell out: exactly the seats of the flight get booked, however many threads race
+    double t = run_threads(sell_out, num_threads, false);
+    printf("sell out:   %d booked, %d left (%s) in %.3f ms\n", atomic_load(&sold_by_threads),
+           seats_remaining(bench_tt, hot_flight, ECONOMY),
+           atomic_load(&sold_by_threads) == capacity ? "ok" : "OVERSOLD", t * 1000);
+
+    //itineraries ending on the full flight fail and give their first leg back
+    atomic_store(&sold_by_threads, 0);
+    run_threads(book_itinerary, num_threads, true);
+    bool legs_free = true;
+    for (int f = 0; f < bench_tt->num_flights; f++) {
+        if (f != hot_flight && seats_remaining(bench_tt, f, ECONOMY) != bench_tt->flights[f].seats[ECONOMY])
+            legs_free = false;
+    }
+    printf("two legs:   %d booked, first legs %s\n", atomic_load(&sold_by_threads),
+           legs_free ? "all released" : "LEAKED");
+
+    //reserve/release churn on the hot flight, with seats left
+    release_flight_seats(bench_tt, hot_flight, ECONOMY, capacity);
+    t = run_threads(churn, num_threads, false);
+    printf("cas:        %.2f M reserve+release/s\n", (double)num_threads * rounds / t / 1e6);
+    t = run_threads(churn_locked, num_threads, false);
+    printf("mutex:      %.2f M reserve+release/s\n", (double)num_threads * rounds / t / 1e6);
+
+    timetable_release(bench_tt);
+    return 0;
+}